@@ -0,0 +1,97 @@
+/*
+------------------------------------------------------------------
+
+This file is part of the Open Ephys GUI
+Copyright (C) 2022 Open Ephys
+
+------------------------------------------------------------------
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "AxisCalibrator.h"
+
+void AxisCalibrator::reset (Vector3D<double> referenceAxis)
+{
+    for (auto& row : covariance)
+        row.fill (0);
+
+    reference = referenceAxis.length() > 0 ? referenceAxis.normalised() : Vector3D<double> (0, 0, 1);
+    axis = reference;
+    hasPrevious = false;
+    observedTurns = 0;
+    calibrated = false;
+}
+
+void AxisCalibrator::addSample (const std::array<double, 4>& quaternion, double dt)
+{
+    if (calibrated || dt <= 0)
+        return;
+
+    Quaternion<double> current (quaternion[1], quaternion[2], quaternion[3], quaternion[0]);
+
+    if (current.length() == 0)
+        return;
+
+    current = current.normalised();
+
+    if (! hasPrevious)
+    {
+        previous = current;
+        hasPrevious = true;
+        return;
+    }
+
+    // Incremental rotation between samples. Its vector part is sin(angle / 2) times the rotation axis
+    Quaternion<double> conjugate (-previous.vector, previous.scalar);
+    Quaternion<double> delta = current * conjugate;
+    previous = current;
+
+    if (delta.scalar < 0)
+        delta = Quaternion<double> (-delta.vector, -delta.scalar);
+
+    double angle = 2.0 * std::atan2 (delta.vector.length(), delta.scalar);
+
+    if (angle == 0)
+        return;
+
+    Vector3D<double> rotation = delta.vector.normalised() * angle;
+    Vector3D<double> omega = rotation / dt;
+
+    double decay = std::exp (-dt / forgettingTime);
+    const double w[3] = { omega.x, omega.y, omega.z };
+
+    for (int i = 0; i < 3; i++)
+        for (int j = 0; j < 3; j++)
+            covariance[i][j] = decay * covariance[i][j] + w[i] * w[j] * dt;
+
+    // One power iteration step per sample
+    Vector3D<double> next (covariance[0][0] * axis.x + covariance[0][1] * axis.y + covariance[0][2] * axis.z,
+                           covariance[1][0] * axis.x + covariance[1][1] * axis.y + covariance[1][2] * axis.z,
+                           covariance[2][0] * axis.x + covariance[2][1] * axis.y + covariance[2][2] * axis.z);
+
+    if (next.length() > 0)
+    {
+        axis = next.normalised();
+
+        if (axis * reference < 0)
+            axis = -axis;
+    }
+
+    // Only rotation about the estimated axis counts, so that noise and tilts do not end the warm-up early
+    observedTurns += std::abs (rotation * axis) / MathConstants<double>::twoPi;
+
+    if (observedTurns >= warmupTurns)
+        calibrated = true;
+}
@@ -0,0 +1,68 @@
+/*
+------------------------------------------------------------------
+
+This file is part of the Open Ephys GUI
+Copyright (C) 2022 Open Ephys
+
+------------------------------------------------------------------
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef AXISCALIBRATOR_H_DEFINED
+#define AXISCALIBRATOR_H_DEFINED
+
+#include <BasicJuceHeader.h>
+
+/** Estimates the rotation axis of the tether from a stream of orientations.
+
+    The axis is the principal eigenvector of the angular velocity covariance, tracked with one
+    power iteration per sample so that memory use is constant. Once enough rotation has been
+    observed the estimate is fixed, and further samples are ignored until reset() is called.
+*/
+class AxisCalibrator
+{
+public:
+    /** Clears the estimate. The reference axis sets the initial guess and the sign of the result. */
+    void reset (Vector3D<double> referenceAxis);
+
+    /** Adds an orientation, sampled dt seconds after the previous one. Quaternion values are ordered W/X/Y/Z. */
+    void addSample (const std::array<double, 4>& quaternion, double dt);
+
+    bool isCalibrated() const { return calibrated; }
+
+    /** Returns the current unit-length estimate of the axis. */
+    Vector3D<double> getAxis() const { return axis; }
+
+    /** Total rotation about the estimated axis, in turns, required before the estimate is fixed. */
+    static constexpr double warmupTurns = 2.0;
+
+private:
+    using Matrix = std::array<std::array<double, 3>, 3>;
+
+    Matrix covariance {};
+    Vector3D<double> axis { 0, 0, 1 };
+    Vector3D<double> reference { 0, 0, 1 };
+
+    Quaternion<double> previous;
+    bool hasPrevious = false;
+
+    double observedTurns = 0;
+    bool calibrated = false;
+
+    /** Time constant of the exponential forgetting applied to the covariance, in seconds. */
+    static constexpr double forgettingTime = 30.0;
+};
+
+#endif
@@ -0,0 +1,101 @@
+/*
+------------------------------------------------------------------
+
+This file is part of the Open Ephys GUI
+Copyright (C) 2022 Open Ephys
+
+------------------------------------------------------------------
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "CommutatorClock.h"
+
+RealTimeClock::~RealTimeClock()
+{
+    stopTimer();
+}
+
+void RealTimeClock::start (int intervalMs, std::function<void()> callback)
+{
+    stopTimer();
+    tickCallback = std::move (callback);
+    startTimer (intervalMs);
+}
+
+void RealTimeClock::stop()
+{
+    stopTimer();
+}
+
+bool RealTimeClock::isRunning() const
+{
+    return isTimerRunning();
+}
+
+double RealTimeClock::now() const
+{
+    return Time::getMillisecondCounterHiRes();
+}
+
+void RealTimeClock::hiResTimerCallback()
+{
+    tickCallback();
+}
+
+void VirtualClock::start (int intervalMs, std::function<void()> callback)
+{
+    ScopedLock lock (tickLock);
+
+    tickCallback = std::move (callback);
+    interval = jmax (1, intervalMs);
+    nextTick = currentTime + interval;
+    running = true;
+}
+
+void VirtualClock::stop()
+{
+    // Waits for a tick in progress on another thread, mirroring HighResolutionTimer::stopTimer()
+    ScopedLock lock (tickLock);
+    running = false;
+}
+
+bool VirtualClock::isRunning() const
+{
+    return running;
+}
+
+double VirtualClock::now() const
+{
+    return currentTime;
+}
+
+void VirtualClock::advance (double ms)
+{
+    ScopedLock lock (tickLock);
+
+    const double target = currentTime + ms;
+
+    while (running && nextTick <= target)
+    {
+        currentTime = nextTick;
+        nextTick += interval;
+
+        // Copied so that the callback can safely restart the clock with a different callback
+        auto callback = tickCallback;
+        callback();
+    }
+
+    currentTime = target;
+}
@@ -0,0 +1,89 @@
+/*
+------------------------------------------------------------------
+
+This file is part of the Open Ephys GUI
+Copyright (C) 2022 Open Ephys
+
+------------------------------------------------------------------
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef COMMUTATORCLOCK_H_DEFINED
+#define COMMUTATORCLOCK_H_DEFINED
+
+#include <BasicJuceHeader.h>
+#include <functional>
+
+/** Source of control ticks and time for CommutatorThread. */
+class CommutatorClock
+{
+public:
+    virtual ~CommutatorClock() = default;
+
+    /** Starts calling the callback once every intervalMs. Replaces any callback that is already running. */
+    virtual void start (int intervalMs, std::function<void()> callback) = 0;
+
+    /** Stops the ticks. When this returns, no callback is in progress unless stop() was called from inside the callback. */
+    virtual void stop() = 0;
+
+    virtual bool isRunning() const = 0;
+
+    /** Returns the current time in milliseconds. Only differences between values are meaningful. */
+    virtual double now() const = 0;
+};
+
+/** Ticks on JUCE's HighResolutionTimer thread, using wall-clock time. */
+class RealTimeClock : public CommutatorClock,
+                      private HighResolutionTimer
+{
+public:
+    ~RealTimeClock() override;
+
+    void start (int intervalMs, std::function<void()> callback) override;
+    void stop() override;
+    bool isRunning() const override;
+    double now() const override;
+
+private:
+    void hiResTimerCallback() override;
+
+    std::function<void()> tickCallback;
+};
+
+/** Manually advanced clock. Ticks are delivered synchronously on the thread that calls advance(),
+    so long runs can be simulated faster than real time and reproduced exactly.
+*/
+class VirtualClock : public CommutatorClock
+{
+public:
+    void start (int intervalMs, std::function<void()> callback) override;
+    void stop() override;
+    bool isRunning() const override;
+    double now() const override;
+
+    /** Moves time forward by the given number of milliseconds, delivering every tick that falls due on the way. */
+    void advance (double ms);
+
+private:
+    CriticalSection tickLock;
+
+    std::function<void()> tickCallback;
+    std::atomic<double> currentTime { 0 };
+    double nextTick = 0;
+    int interval = 0;
+    std::atomic<bool> running { false };
+};
+
+#endif
@@ -0,0 +1,115 @@
+/*
+------------------------------------------------------------------
+
+This file is part of the Open Ephys GUI
+Copyright (C) 2022 Open Ephys
+
+------------------------------------------------------------------
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "CommutatorSettingsPanel.h"
+
+CommutatorSettingsPanel::CommutatorSettingsPanel (GenericProcessor* processor_)
+    : processor (processor_)
+{
+    addToggle ("twist_channel", "Twist channel");
+    addToggle ("turns_channel", "Turns channel");
+    addChoice ("serial_protocol", "Serial protocol", { "JSON", "Binary" });
+    addChoice ("motion_mode", "Motion mode", { "Discrete", "Profiled" });
+    addNumber ("max_speed", "Max speed", 0.05, 10.0, 0.05, " turns/s");
+    addNumber ("max_acceleration", "Max acceleration", 0.1, 50.0, 0.1, " turns/s2");
+    addToggle ("auto_unwind", "Auto unwind");
+    addToggle ("shared_memory", "Shared memory");
+    addToggle ("flight_recorder", "Flight recorder");
+    addToggle ("realtime_priority", "Real-time priority");
+    addNumber ("cpu_core", "CPU core", -1, 31, 1, {});
+    addToggle ("lock_memory", "Lock memory");
+
+    bool editable = ! CoreServices::getAcquisitionStatus();
+
+    for (auto* control : controls)
+        control->setEnabled (editable);
+
+    setSize (labelWidth + controlWidth + 3 * margin, controls.size() * (rowHeight + 4) + 2 * margin);
+}
+
+void CommutatorSettingsPanel::addToggle (const String& parameterName, const String& label)
+{
+    auto toggle = std::make_unique<ToggleButton>();
+    toggle->setToggleState ((bool) processor->getParameter (parameterName)->getValue(), dontSendNotification);
+
+    auto* button = toggle.get();
+    toggle->onClick = [this, parameterName, button]
+    { processor->getParameter (parameterName)->setNextValue (button->getToggleState()); };
+
+    addRow (parameterName, label, std::move (toggle));
+}
+
+void CommutatorSettingsPanel::addChoice (const String& parameterName, const String& label, const StringArray& choices)
+{
+    auto comboBox = std::make_unique<ComboBox>();
+    comboBox->addItemList (choices, 1);
+    comboBox->setSelectedItemIndex ((int) processor->getParameter (parameterName)->getValue(), dontSendNotification);
+
+    auto* box = comboBox.get();
+    comboBox->onChange = [this, parameterName, box]
+    { processor->getParameter (parameterName)->setNextValue (box->getSelectedItemIndex()); };
+
+    addRow (parameterName, label, std::move (comboBox));
+}
+
+void CommutatorSettingsPanel::addNumber (const String& parameterName, const String& label, double minimum, double maximum, double step, const String& suffix)
+{
+    auto slider = std::make_unique<Slider> (Slider::IncDecButtons, Slider::TextBoxLeft);
+    slider->setRange (minimum, maximum, step);
+    slider->setTextValueSuffix (suffix);
+    slider->setValue ((double) processor->getParameter (parameterName)->getValue(), dontSendNotification);
+
+    bool isInteger = step == 1;
+    auto* s = slider.get();
+    slider->onValueChange = [this, parameterName, s, isInteger]
+    {
+        if (isInteger)
+            processor->getParameter (parameterName)->setNextValue (roundToInt (s->getValue()));
+        else
+            processor->getParameter (parameterName)->setNextValue ((float) s->getValue());
+    };
+
+    addRow (parameterName, label, std::move (slider));
+}
+
+void CommutatorSettingsPanel::addRow (const String& parameterName, const String& label, std::unique_ptr<Component> control)
+{
+    auto* rowLabel = labels.add (new Label (parameterName, label));
+    rowLabel->setFont (FontOptions ("Inter", "Regular", 14.0f));
+    addAndMakeVisible (rowLabel);
+
+    if (auto* client = dynamic_cast<SettableTooltipClient*> (control.get()))
+        client->setTooltip (processor->getParameter (parameterName)->getDescription());
+
+    addAndMakeVisible (controls.add (control.release()));
+}
+
+void CommutatorSettingsPanel::resized()
+{
+    for (int i = 0; i < controls.size(); i++)
+    {
+        int y = margin + i * (rowHeight + 4);
+
+        labels[i]->setBounds (margin, y, labelWidth, rowHeight);
+        controls[i]->setBounds (2 * margin + labelWidth, y, controlWidth, rowHeight);
+    }
+}
@@ -0,0 +1,60 @@
+/*
+------------------------------------------------------------------
+
+This file is part of the Open Ephys GUI
+Copyright (C) 2022 Open Ephys
+
+------------------------------------------------------------------
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef COMMUTATORSETTINGSPANEL_H_DEFINED
+#define COMMUTATORSETTINGSPANEL_H_DEFINED
+
+#include <EditorHeaders.h>
+
+/** Controls for the commutator's less frequently used parameters, shown in a call-out box from the editor.
+    Every control reads its parameter when the panel opens and writes it back when changed. The controls are
+    disabled while acquisition is running, since the parameters only take effect when it starts.
+*/
+class CommutatorSettingsPanel : public Component
+{
+public:
+    CommutatorSettingsPanel (GenericProcessor* processor);
+
+    void resized() override;
+
+private:
+    void addToggle (const String& parameterName, const String& label);
+    void addChoice (const String& parameterName, const String& label, const StringArray& choices);
+    void addNumber (const String& parameterName, const String& label, double minimum, double maximum, double step, const String& suffix);
+
+    /** Adds a labelled row holding the given control. */
+    void addRow (const String& parameterName, const String& label, std::unique_ptr<Component> control);
+
+    GenericProcessor* processor;
+
+    OwnedArray<Label> labels;
+    OwnedArray<Component> controls;
+
+    static constexpr int rowHeight = 22;
+    static constexpr int labelWidth = 130;
+    static constexpr int controlWidth = 120;
+    static constexpr int margin = 8;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (CommutatorSettingsPanel);
+};
+
+#endif
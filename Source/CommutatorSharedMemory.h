@@ -0,0 +1,193 @@
+/*
+------------------------------------------------------------------
+
+This file is part of the Open Ephys GUI
+Copyright (C) 2022 Open Ephys
+
+------------------------------------------------------------------
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+    Layout of the shared-memory region in which the commutator publishes its live state, and
+    helpers for reading it. This header is plain C so that external tools can include it directly.
+
+    The region is a POSIX shared-memory object named "/oe-commutator-<node id>". It holds the
+    latest control state behind a seqlock, plus two rings of recent state and command records.
+    The single writer never waits for readers. Readers map the region read-only and copy records
+    out, retrying when a record changed while it was being copied.
+
+    Timestamps are in milliseconds of the writer's monotonic clock.
+
+    Reading the latest state:
+
+        int fd = shm_open ("/oe-commutator-100", O_RDONLY, 0);
+        const oe_commutator_shm* shm = mmap (NULL, sizeof (oe_commutator_shm), PROT_READ, MAP_SHARED, fd, 0);
+
+        oe_commutator_state state;
+        if (oe_commutator_shm_is_valid (shm) && oe_commutator_read_latest (shm, &state))
+            ...
+*/
+
+#ifndef COMMUTATORSHAREDMEMORY_H_DEFINED
+#define COMMUTATORSHAREDMEMORY_H_DEFINED
+
+#include <stdint.h>
+#include <string.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#define OE_COMMUTATOR_SHM_PREFIX "/oe-commutator-"
+#define OE_COMMUTATOR_SHM_MAGIC 0x4d43454fu /* "OECM" */
+#define OE_COMMUTATOR_SHM_VERSION 1u
+#define OE_COMMUTATOR_SHM_STATE_RECORDS 1024u
+#define OE_COMMUTATOR_SHM_COMMAND_RECORDS 256u
+
+/** Where a command came from. */
+enum
+{
+    OE_COMMUTATOR_COMMAND_TRACKING = 0,
+    OE_COMMUTATOR_COMMAND_MANUAL = 1,
+    OE_COMMUTATOR_COMMAND_UNWIND = 2,
+};
+
+/** Set in a command's source when it could not be written to the serial port. Failed commands are not included in cumulative_turns. */
+#define OE_COMMUTATOR_COMMAND_FAILED 0x80000000u
+
+/** Control state at one tick. The quaternion is ordered W/X/Y/Z, twist values are in turns. */
+typedef struct
+{
+    uint64_t sequence;
+    double timestamp;
+    double quaternion[4];
+    double twist;
+    double cumulative_twist;
+    double cumulative_turns;
+} oe_commutator_state;
+
+/** One relative turn command written to the serial port. */
+typedef struct
+{
+    uint64_t sequence;
+    double timestamp;
+    double turn;
+    double cumulative_turns;
+    uint32_t num_bytes;
+    uint32_t source;
+} oe_commutator_command;
+
+typedef struct
+{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t state_capacity;
+    uint32_t command_capacity;
+
+    /** Seqlock-protected copy of the most recent state. Its sequence field is the lock. */
+    oe_commutator_state latest;
+
+    /** Number of records ever written to each ring. Record n lives at index n % capacity. */
+    uint64_t state_count;
+    uint64_t command_count;
+
+    oe_commutator_state states[OE_COMMUTATOR_SHM_STATE_RECORDS];
+    oe_commutator_command commands[OE_COMMUTATOR_SHM_COMMAND_RECORDS];
+} oe_commutator_shm;
+
+static inline int oe_commutator_shm_is_valid (const oe_commutator_shm* shm)
+{
+    return shm != NULL
+           && __atomic_load_n (&shm->magic, __ATOMIC_ACQUIRE) == OE_COMMUTATOR_SHM_MAGIC
+           && shm->version == OE_COMMUTATOR_SHM_VERSION;
+}
+
+/* Writer side of the seqlock. The sequence is odd while the record is being written. */
+static inline void oe_commutator_seqlock_begin (uint64_t* sequence)
+{
+    __atomic_store_n (sequence, *sequence + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence (__ATOMIC_RELEASE);
+}
+
+static inline void oe_commutator_seqlock_end (uint64_t* sequence)
+{
+    __atomic_store_n (sequence, *sequence + 1, __ATOMIC_RELEASE);
+}
+
+/* Copies a seqlock-protected record whose first field is its sequence. Returns 0 if the writer kept changing it. */
+static inline int oe_commutator_seqlock_read (const void* record, void* copy, size_t size)
+{
+    const uint64_t* sequence = (const uint64_t*) record;
+    int attempt;
+
+    for (attempt = 0; attempt < 64; attempt++)
+    {
+        uint64_t before = __atomic_load_n (sequence, __ATOMIC_ACQUIRE);
+
+        if (before & 1u)
+            continue;
+
+        memcpy (copy, record, size);
+        __atomic_thread_fence (__ATOMIC_ACQUIRE);
+
+        if (__atomic_load_n (sequence, __ATOMIC_RELAXED) == before)
+            return 1;
+    }
+
+    return 0;
+}
+
+/** Copies the most recent state. Returns 0 if no consistent copy could be made. */
+static inline int oe_commutator_read_latest (const oe_commutator_shm* shm, oe_commutator_state* state)
+{
+    return oe_commutator_seqlock_read (&shm->latest, state, sizeof (*state));
+}
+
+/** Copies state record n, counting from the first record ever written. Returns 0 if it has been overwritten or not written yet. */
+static inline int oe_commutator_read_state (const oe_commutator_shm* shm, uint64_t n, oe_commutator_state* state)
+{
+    uint64_t count = __atomic_load_n (&shm->state_count, __ATOMIC_ACQUIRE);
+
+    if (n >= count || count - n > shm->state_capacity)
+        return 0;
+
+    if (! oe_commutator_seqlock_read (&shm->states[n % shm->state_capacity], state, sizeof (*state)))
+        return 0;
+
+    /* A record overwritten between the count check and the copy carries a newer sequence */
+    return state->sequence == 2 * (n / shm->state_capacity + 1);
+}
+
+/** Copies command record n, counting from the first command ever written. Returns 0 if it has been overwritten or not written yet. */
+static inline int oe_commutator_read_command (const oe_commutator_shm* shm, uint64_t n, oe_commutator_command* command)
+{
+    uint64_t count = __atomic_load_n (&shm->command_count, __ATOMIC_ACQUIRE);
+
+    if (n >= count || count - n > shm->command_capacity)
+        return 0;
+
+    if (! oe_commutator_seqlock_read (&shm->commands[n % shm->command_capacity], command, sizeof (*command)))
+        return 0;
+
+    return command->sequence == 2 * (n / shm->command_capacity + 1);
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -23,64 +23,192 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include "CommutatorThread.h"
 #include <algorithm>
 
+CommutatorThread::CommutatorThread (std::unique_ptr<CommutatorClock> clock_)
+    : clock (std::move (clock_))
+{
+}
+
+CommutatorThread::~CommutatorThread()
+{
+    clock->stop();
+}
+
 void CommutatorThread::setSerial (String port)
 {
-    if (port.isEmpty())
-        return;
+    connection.connect (port);
+}
 
-    ScopedLock lock (serialLock);
-    serial.close();
-    open = serial.setup (port.toRawUTF8(), 9600);
+void CommutatorThread::setProtocolPreference (SerialProtocol::Format preference)
+{
+    connection.setPreferredFormat (preference);
+}
 
-    if (! open)
-    {
-        LOGE ("Unable to open serial port \"" + port + "\".");
-    }
-    else
+SerialProtocol::Format CommutatorThread::getProtocol() const
+{
+    return connection.getFormat();
+}
+
+bool CommutatorThread::waitForConnection (int timeoutMs)
+{
+    return connection.waitForConnection (timeoutMs);
+}
+
+void CommutatorThread::setRotationAxis (Vector3D<double> axis)
+{
+    if (! isRunning)
     {
-        LOGD ("Opened serial port \"" + port + "\".");
+        rotationAxis = axis;
     }
 }
 
-void CommutatorThread::setRotationAxis (Vector3D<double> axis)
+void CommutatorThread::updateRotationAxis (Vector3D<double> axis)
 {
     if (! isRunning)
     {
         rotationAxis = axis;
+        return;
+    }
+
+    SpinLock::ScopedLockType lock (axisLock);
+    pendingAxis = axis;
+    hasPendingAxis = true;
+}
+
+bool CommutatorThread::isValidAxis (Vector3D<double> axis)
+{
+    return std::abs (axis.length() - 1.0) < 1e-6;
+}
+
+void CommutatorThread::setQuaternion (std::array<double, 4> quaternion, int64 sampleNumber)
+{
+    runningQuaternion = QuaternionSample { quaternion, sampleNumber };
+}
+
+void CommutatorThread::setSampleRate (double sampleRate)
+{
+    jassert (! isRunning);
+    quaternionSampleRate = sampleRate;
+}
+
+void CommutatorThread::setTickInterval (int intervalMs)
+{
+    tickIntervalMs = jmax (1, intervalMs);
+}
+
+void CommutatorThread::setMotionMode (MotionMode mode, MotionPlanner::Limits limits)
+{
+    jassert (! isRunning);
+    motionMode = mode;
+    planner.setLimits (limits);
+}
+
+void CommutatorThread::setAutoUnwind (bool enabled, UnwindScheduler::Settings settings)
+{
+    jassert (! isRunning);
+    autoUnwind = enabled;
+    unwinder.setSettings (settings);
+}
+
+bool CommutatorThread::setSharedStateExport (bool enabled, const String& name)
+{
+    jassert (! isRunning);
+
+    if (! enabled)
+    {
+        sharedState.close();
+        return true;
     }
+
+    // Keep an existing region, so that readers that already mapped it stay connected across acquisitions
+    if (sharedState.isOpen())
+        return true;
+
+    return sharedState.open (name);
+}
+
+void CommutatorThread::setFlightRecorder (bool enabled, const File& directory)
+{
+    jassert (! isRunning);
+
+    if (enabled)
+        flightRecorder.enable (directory, tickIntervalMs);
+    else
+        flightRecorder.disable();
+}
+
+void CommutatorThread::setSchedulingOptions (SchedulingOptions options)
+{
+    jassert (! isRunning);
+    schedulingOptions = options;
+}
+
+CommutatorThread::JitterStatistics CommutatorThread::getJitterStatistics() const
+{
+    return jitter;
+}
+
+void CommutatorThread::addListener (Listener* listener)
+{
+    jassert (! isRunning);
+    listeners.add (listener);
 }
 
-void CommutatorThread::setQuaternion (std::array<double, 4> quaternion)
+void CommutatorThread::removeListener (Listener* listener)
 {
-    runningQuaternion = quaternion;
+    jassert (! isRunning);
+    listeners.remove (listener);
 }
 
-bool CommutatorThread::isReady() const
+bool CommutatorThread::isReady (String& statusMessage) const
 {
-    if (! open)
+    bool open = connection.isOpen();
+
+    if (connection.getState() == SerialConnectionManager::State::Connecting)
+    {
+        LOGE ("Serial port is still connecting. Cannot start until the port is opened.");
+        statusMessage = "Serial port is connecting.";
+    }
+    else if (! open)
     {
         LOGE ("Serial port is not open. Cannot start until the port is opened.");
-        CoreServices::sendStatusMessage ("Commutator: Serial port is not open.");
+        statusMessage = "Serial port is not open.";
     }
 
-    if (rotationAxis.length() != 1)
+    if (! isValidAxis (rotationAxis))
     {
         LOGE ("Rotation axis is invalid. Expected a total length of 1, but length is ", rotationAxis.length());
-        CoreServices::sendStatusMessage ("Commutator: Invalid rotation axis");
+        statusMessage = "Invalid rotation axis";
     }
 
-    return open && rotationAxis.length() == 1;
+    return open && isValidAxis (rotationAxis);
 }
 
 bool CommutatorThread::start()
 {
     lastTwist = std::numeric_limits<double>::quiet_NaN();
-    previousAngleAboutAxis = std::numeric_limits<double>::quiet_NaN();
-    runningQuaternion = defaultQuaternion;
+    twistEstimator.setAxis (rotationAxis);
+    twistEstimator.reset();
+    runningQuaternion = QuaternionSample { defaultQuaternion, -1 };
+    lastSampleNumber = -1;
+    lastTickTime = clock->now();
 
-    if (open && rotationAxis.length() == 1)
+    jitter = {};
+    intervalSumOfSquares = 0;
+
+    planner.reset();
+    unwinder.reset();
+    hasPendingAxis = false;
+
+    cumulativeTwist = 0;
+    cumulativeTurns = 0;
+    failedCommands = 0;
+
+    if (connection.isOpen() && isValidAxis (rotationAxis))
     {
-        startTimer (100);
+        schedulingApplied = false;
+        memoryLocked = ThreadScheduling::lockProcessMemory (schedulingOptions);
+
+        clock->start (tickIntervalMs, [this] { tick(); });
         isRunning = true;
         return true;
     }
@@ -93,73 +221,203 @@ bool CommutatorThread::start()
 
 void CommutatorThread::stop()
 {
-    stopTimer();
+    clock->stop();
+
+    if (isRunning && jitter.numTicks > 1)
+    {
+        LOGC ("Commutator tick jitter: ", jitter.numTicks, " ticks, mean interval ", jitter.meanIntervalMs, " ms, std dev ", jitter.stdDevIntervalMs, " ms, max lateness ", jitter.maxLatenessMs, " ms");
+    }
+
+    if (isRunning && failedCommands > 0)
+    {
+        LOGC ("Commutator: ", failedCommands.load(), " turn commands could not be written to the serial port.");
+    }
+
+    if (memoryLocked)
+    {
+        ThreadScheduling::unlockProcessMemory();
+        memoryLocked = false;
+    }
+
     isRunning = false;
 }
 
 void CommutatorThread::manualTurn (double turn)
 {
-    if (open)
-        sendTurn (turn);
+    if (connection.isOpen())
+        sendTurn (turn, CommandSource::Manual);
 }
 
-void CommutatorThread::sendTurn (double turn)
+bool CommutatorThread::sendTurn (double turn, CommandSource source)
 {
-    String json = "{turn: " + String (turn, 5, false) + "}\r\n";
-    const char* str = json.toRawUTF8();
-    int len = json.getNumBytesAsUTF8();
+    double writeStart = clock->now();
+    int n;
 
-    ScopedLock lock (serialLock);
-    int n = serial.writeBytes (reinterpret_cast<unsigned char*> (const_cast<char*> (str)), len);
-}
+    {
+        ScopedLock lock (commandLock);
+        n = connection.writeTurn (turn);
 
-double CommutatorThread::quaternionToTwist (Quaternion<double> quaternion)
-{
-    // Project rotation axis onto the direction axis
-    double dotProduct = quaternion.vector * rotationAxis;
+        uint32 sourceFlags = (uint32) source;
+
+        // Only turns that reached the device count, so that the unwind residual sees the ones that did not
+        if (n > 0)
+        {
+            cumulativeTurns = cumulativeTurns + turn;
+        }
+        else
+        {
+            if (failedCommands++ == 0)
+                LOGE ("Commutator: could not write a turn command. Turns are not counted until the port is back.");
+
+            sourceFlags |= SharedStateWriter::commandFailed;
+        }
 
-    Vector3D<double> projection = rotationAxis;
-    double scaleFactor = dotProduct / (rotationAxis * rotationAxis);
-    projection *= scaleFactor;
+        // Commands are serialized by the lock, so the ring has a single writer at a time
+        sharedState.writeCommand (clock->now(), turn, cumulativeTurns, n, sourceFlags);
+    }
 
-    Quaternion<double> rotationAboutAxis = Quaternion<double> (projection, quaternion.scalar).normalised();
+    double writeMs = clock->now() - writeStart;
 
-    if (dotProduct < 0) // Account for angle-axis flipping
+    // Manual turns come from the message thread, and are not part of the control loop's history
+    if (source != CommandSource::Manual)
     {
-        rotationAboutAxis = Quaternion<double> (-rotationAboutAxis.vector, -rotationAboutAxis.scalar);
+        tickTurn += turn;
+        tickWriteMs += writeMs;
+        tickBytes += jmax (0, n);
     }
 
-    // Normalize twist feedback in units of turns
-    double angleAboutAxis = 2 * std::acos (rotationAboutAxis.scalar);
+    listeners.call ([=] (Listener& l) { l.turnSent (turn, n, writeMs); });
 
-    double twist = ! isnan (previousAngleAboutAxis)
-                       ? std::fmod (angleAboutAxis - previousAngleAboutAxis + 3 * MathConstants<double>::pi, MathConstants<double>::twoPi) - MathConstants<double>::pi
-                       : 0;
+    return n > 0;
+}
 
-    previousAngleAboutAxis = angleAboutAxis;
+void CommutatorThread::updateJitterStatistics (double intervalMs)
+{
+    // The first tick follows start() rather than another tick, so it is excluded
+    if (jitter.numTicks++ == 0)
+        return;
 
-    return -twist / MathConstants<double>::twoPi;
+    int64 n = jitter.numTicks - 1;
+    double delta = intervalMs - jitter.meanIntervalMs;
+    jitter.meanIntervalMs += delta / (double) n;
+    intervalSumOfSquares += delta * (intervalMs - jitter.meanIntervalMs);
+    jitter.stdDevIntervalMs = n > 1 ? std::sqrt (intervalSumOfSquares / (double) (n - 1)) : 0;
+    jitter.maxLatenessMs = jmax (jitter.maxLatenessMs, intervalMs - tickIntervalMs);
 }
 
-void CommutatorThread::hiResTimerCallback()
+double CommutatorThread::updateTwist (const QuaternionSample& sample, double interval)
 {
-    std::array<double, 4> currentQuaternion = runningQuaternion;
+    const auto& q = sample.quaternion;
+    Quaternion<double> orientation (q[1], q[2], q[3], q[0]);
 
-    if (currentQuaternion == defaultQuaternion)
-        return;
+    // Time between the samples the orientations came from. This is longer than a tick when blocks were
+    // dropped, and zero when no new block arrived since the previous tick
+    double elapsed = interval / 1000.0;
 
-    double currentTwist = quaternionToTwist (Quaternion<double> (currentQuaternion[1], currentQuaternion[2], currentQuaternion[3], currentQuaternion[0]));
+    if (sample.sampleNumber >= 0 && lastSampleNumber >= 0 && quaternionSampleRate > 0)
+        elapsed = (double) (sample.sampleNumber - lastSampleNumber) / quaternionSampleRate;
+
+    lastSampleNumber = sample.sampleNumber;
+
+    double currentTwist = twistEstimator.update (orientation, elapsed);
 
     if (! isnan (lastTwist))
     {
-        if (std::abs (currentTwist) > 0.01)
+        cumulativeTwist = cumulativeTwist + currentTwist;
+        bool tracking = false;
+
+        if (motionMode == MotionMode::Profiled)
         {
-            sendTurn (currentTwist);
+            planner.addTarget (currentTwist);
+            double turn = planner.update (interval / 1000.0);
+
+            // A waypoint that failed to send stays pending, and is retried with the rest of the profile on the next tick
+            if (turn != 0 && sendTurn (turn, CommandSource::Tracking))
+                planner.commandSent (turn);
+
+            tracking = turn != 0 || planner.isMoving();
             lastTwist = currentTwist;
         }
+        else if (std::abs (currentTwist) > minTrackingSpeed * jmax (elapsed, interval / 1000.0))
+        {
+            sendTurn (currentTwist, CommandSource::Tracking);
+            tracking = true;
+            lastTwist = currentTwist;
+        }
+
+        if (autoUnwind)
+        {
+            // Manual turns count, since they are how the operator removes residual twist by hand
+            double residual = cumulativeTwist - cumulativeTurns;
+            double unwindTurn = unwinder.update (orientation, residual, elapsed, tracking);
+
+            if (unwindTurn != 0)
+            {
+                LOGD ("Commutator: unwinding ", unwindTurn, " turns of residual twist ", residual);
+                sendTurn (unwindTurn, CommandSource::Unwind);
+            }
+        }
     }
     else
     {
         lastTwist = currentTwist;
     }
+
+    return currentTwist;
+}
+
+void CommutatorThread::tick()
+{
+    if (! schedulingApplied)
+    {
+        // The clock owns the thread, so the options can only be applied from inside a tick
+        ThreadScheduling::applyToCurrentThread (schedulingOptions);
+        schedulingApplied = true;
+    }
+
+    double now = clock->now();
+    double interval = now - lastTickTime;
+    lastTickTime = now;
+
+    updateJitterStatistics (interval);
+
+    if (hasPendingAxis)
+    {
+        SpinLock::ScopedLockType lock (axisLock);
+
+        if (isValidAxis (pendingAxis))
+        {
+            rotationAxis = pendingAxis;
+            twistEstimator.setAxis (rotationAxis);
+        }
+
+        hasPendingAxis = false;
+    }
+
+    QuaternionSample sample = runningQuaternion;
+    const auto& currentQuaternion = sample.quaternion;
+
+    tickTurn = 0;
+    tickWriteMs = 0;
+    tickBytes = 0;
+
+    double currentTwist = 0;
+
+    if (currentQuaternion != defaultQuaternion)
+    {
+        currentTwist = updateTwist (sample, interval);
+        sharedState.writeState (now, currentQuaternion, currentTwist, cumulativeTwist, cumulativeTurns);
+    }
+
+    flightRecorder.addRecord ({ now,
+                                interval,
+                                sample.sampleNumber,
+                                { currentQuaternion[0], currentQuaternion[1], currentQuaternion[2], currentQuaternion[3] },
+                                currentTwist,
+                                tickTurn,
+                                tickWriteMs,
+                                (uint32) tickBytes,
+                                0 });
+
+    listeners.call ([=] (Listener& l) { l.tickCompleted (interval); });
 }
@@ -24,45 +24,211 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #define COMMUTATORTHREAD_H_DEFINFED
 
 #include "../../Source/Utils/Utils.h"
-#include "../../Source/CoreServices.h"
+#include "CommutatorClock.h"
+#include "FlightRecorder.h"
+#include "MotionPlanner.h"
+#include "SerialConnectionManager.h"
+#include "SerialProtocol.h"
+#include "SharedStateWriter.h"
+#include "ThreadScheduling.h"
+#include "TwistEstimator.h"
+#include "UnwindScheduler.h"
 #include <BasicJuceHeader.h>
-#include <SerialLib.h>
 #include <atomic>
 #include <cmath>
 #include <limits>
 
-class CommutatorThread : public HighResolutionTimer
+class CommutatorThread
 {
 public:
+    /** Receives notifications from the control loop. Listeners must be added or removed while the thread is stopped.
+        Notifications are serialized, so a listener never receives two at once, even from different threads.
+    */
+    class Listener
+    {
+    public:
+        virtual ~Listener() = default;
+
+        /** Called on the clock's thread at the end of every control tick, with the time elapsed since the previous tick. */
+        virtual void tickCompleted (double intervalMs) {}
+
+        /** Called after a turn command has been written. May be called from the timer thread or the message thread. */
+        virtual void turnSent (double turn, int numBytes, double writeMs) {}
+    };
+
+    /** Creates a thread driven by the given clock. By default, ticks come from a RealTimeClock. */
+    CommutatorThread (std::unique_ptr<CommutatorClock> clock = std::make_unique<RealTimeClock>());
+    ~CommutatorThread();
+
+    /** Requests the serial port, by path or stable ID. The port is opened in the background and kept open,
+        and if the binary protocol is preferred, it is negotiated with the device there.
+    */
     void setSerial (String port);
+
+    /** Sets the preferred command format. An open port is reopened in the background to negotiate it if it changed. */
+    void setProtocolPreference (SerialProtocol::Format preference);
+
+    /** Waits for the serial port requested by setSerial() to be opened. Returns true if it is open. */
+    bool waitForConnection (int timeoutMs);
+
+    /** Returns the command format in use on the open port. */
+    SerialProtocol::Format getProtocol() const;
+
     bool start();
     void stop();
-    void hiResTimerCallback() override;
     void manualTurn (double turn);
-    /** Sets the values of a Quaternion object using an array. Expected to be ordered as X/Y/Z/W for indices 0-3. */
-    void setQuaternion (std::array<double, 4> quaternion);
+    /** Sets the values of a Quaternion object using an array. Expected to be ordered as W/X/Y/Z for indices 0-3.
+        The sample number identifies the sample the orientation was taken from. Without it, the time between
+        orientations is taken from the tick interval.
+    */
+    void setQuaternion (std::array<double, 4> quaternion, int64 sampleNumber = -1);
+    /** Sets the sample rate of the quaternion stream, used to convert sample numbers to time. */
+    void setSampleRate (double sampleRate);
     void setRotationAxis (Vector3D<double> axis);
-    bool isReady() const;
+    /** Replaces the rotation axis, including while running. A running thread switches axes at its next tick. */
+    void updateRotationAxis (Vector3D<double> axis);
+    /** Sets the control tick period used by the next call to start(). Defaults to 100 ms. */
+    void setTickInterval (int intervalMs);
+    /** Returns true if the thread can be started. Otherwise, statusMessage is set to a short description of the problem. */
+    bool isReady (String& statusMessage) const;
+
+    enum class MotionMode
+    {
+        /** Send each tick's twist as a single relative turn. */
+        Discrete,
+        /** Follow the twist with a velocity-limited profile, sent as sparse waypoints. */
+        Profiled,
+    };
+
+    /** Sets how twist is turned into motor commands. Takes effect at the next call to start(). */
+    void setMotionMode (MotionMode mode, MotionPlanner::Limits limits = {});
+
+    /** Enables unwinding of residual tether twist while the animal is still. Takes effect at the next call to start(). */
+    void setAutoUnwind (bool enabled, UnwindScheduler::Settings settings = {});
+
+    /** Returns the total twist measured since start(), in turns. */
+    double getCumulativeTwist() const { return cumulativeTwist; }
+
+    /** Returns the total of all turns written since start(), including manual turns. Commands that failed to write are not included. */
+    double getCumulativeTurns() const { return cumulativeTurns; }
+
+    /** Returns the number of turn commands that could not be written since start(). */
+    int getNumFailedCommands() const { return failedCommands; }
+
+    /** Publishes the live state and commands in the named shared-memory region, or stops publishing.
+        Must be called while the thread is stopped. Returns false if the region could not be created.
+    */
+    bool setSharedStateExport (bool enabled, const String& name);
+
+    /** Keeps a history of recent ticks in memory, and dumps it to the given directory when an anomaly
+        is detected. Must be called while the thread is stopped, after the tick interval has been set.
+    */
+    void setFlightRecorder (bool enabled, const File& directory);
+
+    /** Timing statistics of the control ticks since the last call to start(). */
+    struct JitterStatistics
+    {
+        int64 numTicks = 0;
+        double meanIntervalMs = 0;
+        double stdDevIntervalMs = 0;
+        double maxLatenessMs = 0;
+    };
+
+    /** Sets the scheduling options applied to the control thread by the next call to start(). */
+    void setSchedulingOptions (SchedulingOptions options);
+
+    /** Returns the tick timing statistics. Only consistent while the thread is stopped. */
+    JitterStatistics getJitterStatistics() const;
+
+    void addListener (Listener* listener);
+    void removeListener (Listener* listener);
+
+    CommutatorClock& getClock() { return *clock; }
 
 private:
-    /** Converts quaternion data to a twist. Quaternion values are expected to be ordered X/Y/Z/W. */
-    double quaternionToTwist (Quaternion<double> quaternion);
-    void sendTurn (double turn);
+    /** Orientation and position in the stream of the most recent quaternion sample. */
+    struct QuaternionSample
+    {
+        std::array<double, 4> quaternion;
+        int64 sampleNumber;
+    };
+
+    /** Runs one iteration of the control loop. Called by the clock once per tick interval. */
+    void tick();
+
+    /** Measures the twist since the previous tick and sends the resulting commands. Returns the twist, in turns. */
+    double updateTwist (const QuaternionSample& sample, double interval);
+
+    void updateJitterStatistics (double intervalMs);
+
+    static bool isValidAxis (Vector3D<double> axis);
+
+    /** Where a turn command came from. Values match the OE_COMMUTATOR_COMMAND_* constants in CommutatorSharedMemory.h. */
+    enum class CommandSource : uint32
+    {
+        Tracking = 0,
+        Manual = 1,
+        Unwind = 2,
+    };
+
+    /** Writes a turn command to the motor. Returns false if it did not reach the device. */
+    bool sendTurn (double turn, CommandSource source);
+
+    std::unique_ptr<CommutatorClock> clock;
 
-    ofSerial serial;
+    SerialConnectionManager connection;
 
     double lastTwist = std::numeric_limits<double>::quiet_NaN();
-    double previousAngleAboutAxis = std::numeric_limits<double>::quiet_NaN();
+    TwistEstimator twistEstimator;
 
     static inline const std::array<double, 4> defaultQuaternion { 0.0, 0.0, 0.0, 0.0 };
 
-    std::atomic<std::array<double, 4>> runningQuaternion;
+    std::atomic<QuaternionSample> runningQuaternion;
+    int64 lastSampleNumber = -1;
+    double quaternionSampleRate = 0;
+
+    /** Twist speed, in turns per second, below which the discrete mode sends no command. */
+    static constexpr double minTrackingSpeed = 0.1;
     Vector3D<double> rotationAxis = Vector3D<double> (0, 0, 0);
 
-    bool open = false;
+    SpinLock axisLock;
+    Vector3D<double> pendingAxis;
+    std::atomic<bool> hasPendingAxis { false };
+
     std::atomic<bool> isRunning = false;
 
-    CriticalSection serialLock;
+    int tickIntervalMs = 100;
+    double lastTickTime = 0;
+
+    MotionMode motionMode = MotionMode::Discrete;
+    MotionPlanner planner;
+
+    bool autoUnwind = false;
+    UnwindScheduler unwinder;
+
+    SharedStateWriter sharedState;
+
+    FlightRecorder flightRecorder;
+    double tickTurn = 0;
+    double tickWriteMs = 0;
+    int tickBytes = 0;
+
+    std::atomic<double> cumulativeTwist { 0 };
+    std::atomic<double> cumulativeTurns { 0 };
+    std::atomic<int> failedCommands { 0 };
+
+    SchedulingOptions schedulingOptions;
+    bool schedulingApplied = false;
+    bool memoryLocked = false;
+
+    JitterStatistics jitter;
+    double intervalSumOfSquares = 0;
+
+    /** Manual turns notify from the message thread while ticks notify from the clock's thread, so calls are locked. */
+    ListenerList<Listener, Array<Listener*, CriticalSection>> listeners;
+
+    /** Serializes commands from the control loop and the message thread. */
+    CriticalSection commandLock;
 };
 
 #endif
@@ -0,0 +1,179 @@
+/*
+------------------------------------------------------------------
+
+This file is part of the Open Ephys GUI
+Copyright (C) 2022 Open Ephys
+
+------------------------------------------------------------------
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "FlightRecorder.h"
+#include "../../Source/Utils/Utils.h"
+
+FlightRecorder::FlightRecorder()
+    : Thread ("Commutator Flight Recorder")
+{
+}
+
+FlightRecorder::~FlightRecorder()
+{
+    disable();
+}
+
+void FlightRecorder::enable (const File& directory, int tickIntervalMs, Settings newSettings)
+{
+    disable();
+
+    dumpDirectory = directory;
+    settings = newSettings;
+    nominalIntervalMs = jmax (1, tickIntervalMs);
+
+    capacity = jmax (1, (int) std::ceil (settings.historySeconds * 1000.0 / nominalIntervalMs));
+    ring.calloc ((size_t) capacity);
+    snapshot.calloc ((size_t) capacity);
+    writeIndex = 0;
+    numRecords = 0;
+    dumpPending = false;
+    lastDumpTime = std::numeric_limits<double>::lowest();
+
+    startThread();
+}
+
+void FlightRecorder::disable()
+{
+    if (isThreadRunning())
+    {
+        signalThreadShouldExit();
+        notify();
+        stopThread (1000);
+    }
+
+    // A dump triggered just before stopping is still worth keeping
+    if (dumpPending)
+        writeDump();
+
+    capacity = 0;
+    ring.free();
+    snapshot.free();
+}
+
+void FlightRecorder::addRecord (Record record)
+{
+    if (capacity == 0)
+        return;
+
+    uint32 triggers = 0;
+
+    if (std::abs (record.turn) > settings.largeTwistSpeed * jmax (record.intervalMs, nominalIntervalMs) / 1000.0)
+        triggers |= LargeTwist;
+
+    if (record.writeMs > settings.writeStallMs)
+        triggers |= WriteStall;
+
+    if (numRecords > 0 && record.intervalMs > settings.overrunFactor * nominalIntervalMs)
+        triggers |= TimerOverrun;
+
+    record.triggers = triggers;
+    ring[writeIndex] = record;
+    writeIndex = (writeIndex + 1) % capacity;
+    numRecords++;
+
+    if (triggers == 0 || dumpPending || record.timestamp - lastDumpTime < settings.dumpCooldownMs)
+        return;
+
+    // Copy out the history, oldest first, so that the ring can keep running while the dump is written
+    snapshotCount = (int) jmin ((int64) capacity, numRecords);
+    int start = (writeIndex - snapshotCount + capacity) % capacity;
+
+    for (int i = 0; i < snapshotCount; i++)
+        snapshot[i] = ring[(start + i) % capacity];
+
+    snapshotTriggers = triggers;
+    snapshotTime = record.timestamp;
+    lastDumpTime = record.timestamp;
+
+    dumpPending = true;
+    notify();
+}
+
+void FlightRecorder::run()
+{
+    while (! threadShouldExit())
+    {
+        wait (-1);
+
+        if (dumpPending)
+            writeDump();
+    }
+}
+
+void FlightRecorder::writeDump()
+{
+    String reasons;
+
+    if (snapshotTriggers & LargeTwist)
+        reasons += "-twist";
+    if (snapshotTriggers & WriteStall)
+        reasons += "-stall";
+    if (snapshotTriggers & TimerOverrun)
+        reasons += "-overrun";
+
+    File file = dumpDirectory.getChildFile ("commutator-flight-" + Time::getCurrentTime().formatted ("%Y-%m-%d_%H-%M-%S") + reasons + ".bin")
+                    .getNonexistentSibling();
+
+    dumpDirectory.createDirectory();
+    FileOutputStream stream (file);
+
+    if (stream.openedOk())
+    {
+        const char magic[8] = { 'O', 'E', 'C', 'F', 'R', 0, 0, 0 };
+        stream.write (magic, sizeof (magic));
+        stream.writeInt (1);
+        stream.writeInt (recordSize);
+        stream.writeInt (snapshotCount);
+        stream.writeInt ((int) snapshotTriggers);
+        stream.writeDouble (snapshotTime);
+
+        // Field by field, so that the file layout does not depend on the host's byte order or struct padding
+        for (int i = 0; i < snapshotCount; i++)
+        {
+            const Record& record = snapshot[i];
+
+            stream.writeDouble (record.timestamp);
+            stream.writeDouble (record.intervalMs);
+            stream.writeInt64 (record.sampleNumber);
+
+            for (double value : record.quaternion)
+                stream.writeDouble (value);
+
+            stream.writeDouble (record.twist);
+            stream.writeDouble (record.turn);
+            stream.writeDouble (record.writeMs);
+            stream.writeInt ((int) record.bytesWritten);
+            stream.writeInt ((int) record.triggers);
+        }
+
+        stream.flush();
+
+        LOGC ("Commutator: anomaly detected (", reasons.substring (1), "), wrote ", snapshotCount, " ticks of history to ", file.getFullPathName());
+    }
+    else
+    {
+        LOGE ("Commutator: unable to write flight recorder dump to ", file.getFullPathName());
+    }
+
+    dumpPending = false;
+}
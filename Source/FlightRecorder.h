@@ -0,0 +1,138 @@
+/*
+------------------------------------------------------------------
+
+This file is part of the Open Ephys GUI
+Copyright (C) 2022 Open Ephys
+
+------------------------------------------------------------------
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef FLIGHTRECORDER_H_DEFINED
+#define FLIGHTRECORDER_H_DEFINED
+
+#include <BasicJuceHeader.h>
+#include <limits>
+
+/** Keeps the last few seconds of control-loop activity in a preallocated ring, and dumps it to a
+    binary file when an anomaly is detected.
+
+    Each dump file starts with a header:
+
+        char[8]   magic "OECFR\0\0\0"
+        uint32    version
+        uint32    size of one record in bytes
+        uint32    number of records
+        uint32    trigger flags
+        double    time of the triggering tick, in milliseconds
+
+    followed by the records, oldest first. Each record is 88 bytes:
+
+        offset  type       field
+        0       double     tick time, in milliseconds
+        8       double     interval since the previous tick, in milliseconds
+        16      int64      sample number of the quaternion, or -1 if unknown
+        24      double[4]  quaternion, ordered W/X/Y/Z
+        56      double     twist measured during the tick, in turns
+        64      double     turn commanded during the tick
+        72      double     time spent writing commands, in milliseconds
+        80      uint32     bytes written to the serial port
+        84      uint32     trigger flags raised by the tick
+
+    All values are little-endian, whatever the byte order of the host.
+*/
+class FlightRecorder : private Thread
+{
+public:
+    /** Control-loop activity during one tick. Times are in milliseconds. */
+    struct Record
+    {
+        double timestamp;
+        double intervalMs;
+        int64 sampleNumber;
+        double quaternion[4];
+        double twist;
+        double turn;
+        double writeMs;
+        uint32 bytesWritten;
+        uint32 triggers;
+    };
+
+    enum Trigger : uint32
+    {
+        LargeTwist = 1 << 0,
+        WriteStall = 1 << 1,
+        TimerOverrun = 1 << 2,
+    };
+
+    struct Settings
+    {
+        /** Length of history kept, in seconds. */
+        double historySeconds = 30.0;
+
+        /** Commanded turn speed, in turns per second over one tick, above which a dump is triggered. */
+        double largeTwistSpeed = 2.5;
+
+        /** Serial write time above which a dump is triggered. */
+        double writeStallMs = 50.0;
+
+        /** Tick interval, as a multiple of the nominal interval, above which a dump is triggered. */
+        double overrunFactor = 2.0;
+
+        /** Minimum time between dumps, in milliseconds. */
+        double dumpCooldownMs = 10000.0;
+    };
+
+    FlightRecorder();
+    ~FlightRecorder() override;
+
+    /** Allocates the ring and starts the dump thread. Must not be called while records are being added. */
+    void enable (const File& directory, int tickIntervalMs, Settings settings = {});
+
+    void disable();
+
+    bool isEnabled() const { return capacity > 0; }
+
+    /** Adds a record, and schedules a dump if it trips a trigger. Called once per tick from a single thread. Does not allocate. */
+    void addRecord (Record record);
+
+private:
+    void run() override;
+
+    void writeDump();
+
+    /** Size of a record in a dump file, as documented above. */
+    static constexpr int recordSize = 88;
+
+    File dumpDirectory;
+    Settings settings;
+    double nominalIntervalMs = 100;
+
+    HeapBlock<Record> ring;
+    HeapBlock<Record> snapshot;
+    int capacity = 0;
+    int writeIndex = 0;
+    int64 numRecords = 0;
+
+    int snapshotCount = 0;
+    uint32 snapshotTriggers = 0;
+    double snapshotTime = 0;
+    double lastDumpTime = std::numeric_limits<double>::lowest();
+
+    /** Set by the control thread when the snapshot holds a dump, and cleared by the dump thread once it has been written. */
+    std::atomic<bool> dumpPending { false };
+};
+
+#endif
@@ -0,0 +1,85 @@
+/*
+------------------------------------------------------------------
+
+This file is part of the Open Ephys GUI
+Copyright (C) 2022 Open Ephys
+
+------------------------------------------------------------------
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "MotionPlanner.h"
+
+void MotionPlanner::setLimits (Limits newLimits)
+{
+    jassert (newLimits.maxSpeed > 0 && newLimits.maxAcceleration > 0);
+    limits = newLimits;
+}
+
+void MotionPlanner::reset()
+{
+    target = 0;
+    position = 0;
+    velocity = 0;
+    sent = 0;
+}
+
+void MotionPlanner::addTarget (double turns)
+{
+    target += turns;
+}
+
+double MotionPlanner::update (double dt)
+{
+    if (dt <= 0)
+        return 0;
+
+    double error = target - position;
+    double direction = error < 0 ? -1.0 : 1.0;
+    double distance = std::abs (error);
+
+    // Velocity towards the target, and the largest change allowed in one step
+    double approachVelocity = velocity * direction;
+    double maxChange = limits.maxAcceleration * dt;
+
+    if (approachVelocity >= 0 && approachVelocity <= maxChange && distance <= 0.25 * (approachVelocity + maxChange) * dt)
+    {
+        // Close enough to reach the target and stop within this step without exceeding the acceleration limit
+        position = target;
+        velocity = 0;
+    }
+    else
+    {
+        // Fastest speed at the end of this step from which the motor can still stop at the target, accounting
+        // for the distance covered during the step itself so that the final approach never has to brake harder
+        double discriminant = 0.25 * dt * dt + (2.0 * distance - approachVelocity * dt) / limits.maxAcceleration;
+        double stoppingSpeed = discriminant > 0 ? limits.maxAcceleration * (std::sqrt (discriminant) - 0.5 * dt) : -limits.maxSpeed;
+        double desiredVelocity = direction * jmin (limits.maxSpeed, stoppingSpeed);
+
+        double newVelocity = jlimit (velocity - maxChange, velocity + maxChange, desiredVelocity);
+
+        // Integrate with the average velocity over the step
+        position += 0.5 * (velocity + newVelocity) * dt;
+        velocity = newVelocity;
+    }
+
+    double pending = position - sent;
+    bool atRest = velocity == 0 && position == target;
+
+    if (std::abs (pending) >= limits.minStep || (atRest && std::abs (pending) >= limits.deadband))
+        return pending;
+
+    return 0;
+}
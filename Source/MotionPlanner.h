@@ -0,0 +1,78 @@
+/*
+------------------------------------------------------------------
+
+This file is part of the Open Ephys GUI
+Copyright (C) 2022 Open Ephys
+
+------------------------------------------------------------------
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef MOTIONPLANNER_H_DEFINED
+#define MOTIONPLANNER_H_DEFINED
+
+#include <BasicJuceHeader.h>
+
+/** Turns the estimated twist trajectory into a trapezoidal velocity profile that respects the
+    motor's speed and acceleration limits, and emits it as sparse relative waypoints.
+    All positions are in turns, and all times are in seconds.
+*/
+class MotionPlanner
+{
+public:
+    struct Limits
+    {
+        double maxSpeed = 1.0;
+        double maxAcceleration = 2.0;
+
+        /** Smallest waypoint sent while the profile is moving. Smaller remainders are sent once the profile comes to rest. */
+        double minStep = 0.02;
+
+        /** Remainders below this are never sent. */
+        double deadband = 0.005;
+    };
+
+    void setLimits (Limits limits);
+
+    /** Clears the profile. The current position becomes the new origin. */
+    void reset();
+
+    /** Moves the target by the given number of turns. */
+    void addTarget (double turns);
+
+    /** Advances the profile by dt seconds. Returns the relative turn to send now, or 0 if no command is due.
+        The waypoint stays pending, and grows with the profile, until commandSent() reports that it reached the motor.
+    */
+    double update (double dt);
+
+    /** Records that a turn returned by update() was written to the motor. */
+    void commandSent (double turn) { sent += turn; }
+
+    /** Returns the distance between the target and the position sent to the motor. */
+    double getTrackingError() const { return target - sent; }
+
+    /** Returns true until the profile has come to rest at the target. */
+    bool isMoving() const { return velocity != 0 || position != target; }
+
+private:
+    Limits limits;
+
+    double target = 0;
+    double position = 0;
+    double velocity = 0;
+    double sent = 0;
+};
+
+#endif
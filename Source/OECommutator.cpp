@@ -38,6 +38,30 @@ void OECommutator::registerParameters()
     addIntParameter (Parameter::PROCESSOR_SCOPE, "current_stream", "Current Stream", "Currently selected stream", 0, 0, 200000, true);
 
     addStringParameter (Parameter::PROCESSOR_SCOPE, "serial_name", "Serial Name", "Serial port name", "", true);
+
+    addBooleanParameter (Parameter::PROCESSOR_SCOPE, "twist_channel", "Twist Channel", "Add a channel with the cumulative twist, in turns, to the selected stream", false, true);
+
+    addBooleanParameter (Parameter::PROCESSOR_SCOPE, "turns_channel", "Turns Channel", "Add a channel with the cumulative commanded turns to the selected stream", false, true);
+
+    addCategoricalParameter (Parameter::PROCESSOR_SCOPE, "serial_protocol", "Serial Protocol", "Command format. Binary is negotiated when the port is opened, and falls back to JSON if the device does not support it", { "JSON", "Binary" }, 0, true);
+
+    addCategoricalParameter (Parameter::PROCESSOR_SCOPE, "motion_mode", "Motion Mode", "Send discrete turns every tick, or a velocity-limited profile as sparse waypoints", { "Discrete", "Profiled" }, 0, true);
+
+    addFloatParameter (Parameter::PROCESSOR_SCOPE, "max_speed", "Max Speed", "Maximum motor speed used by the profiled motion mode", "turns/s", 1.0f, 0.05f, 10.0f, 0.05f, true);
+
+    addFloatParameter (Parameter::PROCESSOR_SCOPE, "max_acceleration", "Max Acceleration", "Maximum motor acceleration used by the profiled motion mode", "turns/s^2", 2.0f, 0.1f, 50.0f, 0.1f, true);
+
+    addBooleanParameter (Parameter::PROCESSOR_SCOPE, "auto_unwind", "Auto Unwind", "Unwind residual tether twist while the animal is still", false, true);
+
+    addBooleanParameter (Parameter::PROCESSOR_SCOPE, "shared_memory", "Shared Memory", "Publish live twist and commands in a shared-memory region for local tools", false, true);
+
+    addBooleanParameter (Parameter::PROCESSOR_SCOPE, "flight_recorder", "Flight Recorder", "Keep recent control-loop history and dump it to the recording directory when an anomaly occurs", false, true);
+
+    addBooleanParameter (Parameter::PROCESSOR_SCOPE, "realtime_priority", "Real-time Priority", "Run the control thread with real-time (SCHED_FIFO) scheduling when permitted", false, true);
+
+    addIntParameter (Parameter::PROCESSOR_SCOPE, "cpu_core", "CPU Core", "Pin the control thread to this CPU core (-1 to leave unpinned)", -1, -1, 31, true);
+
+    addBooleanParameter (Parameter::PROCESSOR_SCOPE, "lock_memory", "Lock Memory", "Lock the process memory with mlockall during acquisition", false, true);
 }
 
 AudioProcessorEditor* OECommutator::createEditor()
@@ -52,23 +76,45 @@ void OECommutator::parameterValueChanged (Parameter* parameter)
     {
         uint16 candidateStream = (uint16) (int) parameter->getValue();
 
-        if (streamExists (candidateStream))
+        if (streamExists (candidateStream) && candidateStream != currentStream)
+        {
             currentStream = candidateStream;
+
+            // The output channels follow the selected stream
+            if (hasOutputChannels())
+                CoreServices::updateSignalChain (getEditor());
+        }
+    }
+    else if (parameter->getName().equalsIgnoreCase ("twist_channel") || parameter->getName().equalsIgnoreCase ("turns_channel"))
+    {
+        CoreServices::updateSignalChain (getEditor());
     }
     else if (parameter->getName().equalsIgnoreCase ("serial_name"))
     {
         commutator->setSerial (parameter->getValueAsString());
         ((OECommutatorEditor*) editor.get())->setSerialSelection (parameter->getValueAsString().toStdString());
     }
+    else if (parameter->getName().equalsIgnoreCase ("serial_protocol"))
+    {
+        auto preference = (int) parameter->getValue() == 1 ? SerialProtocol::Format::Binary : SerialProtocol::Format::Json;
+        commutator->setProtocolPreference (preference);
+    }
 }
 
 bool OECommutator::isReady()
 {
     std::string axis = ((OECommutatorEditor*) editor.get())->getAxisSelection();
+    autoAxis = axis == "Auto";
     commutator->setRotationAxis (getRotationAxis (axis));
+    outputTwist.setAxis (getRotationAxis (axis));
+
+    String statusMessage;
 
-    if (! commutator->isReady())
+    if (! commutator->isReady (statusMessage))
+    {
+        CoreServices::sendStatusMessage ("Commutator: " + statusMessage);
         return false;
+    }
 
     if (! streamExists (currentStream))
         return false;
@@ -83,14 +129,99 @@ bool OECommutator::isReady()
     return true;
 }
 
+void OECommutator::updateSettings()
+{
+    twistChannel = nullptr;
+    turnsChannel = nullptr;
+
+    if (! streamExists (currentStream))
+        return;
+
+    DataStream* stream = getDataStream (currentStream);
+
+    if ((bool) getParameter ("twist_channel")->getValue())
+        twistChannel = addOutputChannel (stream, "TWIST", "Unwrapped cumulative twist about the rotation axis, in turns", "commutator.twist");
+
+    if ((bool) getParameter ("turns_channel")->getValue())
+        turnsChannel = addOutputChannel (stream, "TURNS", "Cumulative turns commanded to the commutator", "commutator.turns");
+}
+
+ContinuousChannel* OECommutator::addOutputChannel (DataStream* stream, String name, String description, String identifier)
+{
+    ContinuousChannel::Settings settings {
+        ContinuousChannel::Type::AUX,
+        name,
+        description,
+        identifier,
+        1.0f,
+        stream
+    };
+
+    continuousChannels.add (new ContinuousChannel (settings));
+    continuousChannels.getLast()->addProcessor (this);
+    stream->addChannel (continuousChannels.getLast());
+
+    return continuousChannels.getLast();
+}
+
+bool OECommutator::hasOutputChannels() const
+{
+    return twistChannel != nullptr || turnsChannel != nullptr;
+}
+
 bool OECommutator::startAcquisition()
 {
+    outputTwist.reset();
+
+    nextSampleNumber = -1;
+    numGaps = 0;
+    numMissingSamples = 0;
+
+    if (streamExists (currentStream))
+        commutator->setSampleRate (getDataStream (currentStream)->getSampleRate());
+
+    newlyCalibrated = false;
+
+    if (autoAxis && ! hasCalibratedAxis)
+        axisCalibrator.reset (getRotationAxis ("+Z"));
+
+    MotionPlanner::Limits limits;
+    limits.maxSpeed = (float) getParameter ("max_speed")->getValue();
+    limits.maxAcceleration = (float) getParameter ("max_acceleration")->getValue();
+
+    auto mode = (int) getParameter ("motion_mode")->getValue() == 1 ? CommutatorThread::MotionMode::Profiled
+                                                                    : CommutatorThread::MotionMode::Discrete;
+    commutator->setMotionMode (mode, limits);
+    commutator->setAutoUnwind ((bool) getParameter ("auto_unwind")->getValue());
+
+    SchedulingOptions options;
+    options.realtimePriority = (bool) getParameter ("realtime_priority")->getValue();
+    options.cpuCore = (int) getParameter ("cpu_core")->getValue();
+    options.lockMemory = (bool) getParameter ("lock_memory")->getValue();
+    commutator->setSchedulingOptions (options);
+
+    commutator->setSharedStateExport ((bool) getParameter ("shared_memory")->getValue(),
+                                      SharedStateWriter::getRegionName (getNodeId()));
+
+    commutator->setFlightRecorder ((bool) getParameter ("flight_recorder")->getValue(),
+                                   CoreServices::getRecordingParentDirectory());
+
     return commutator->start();
 }
 
 bool OECommutator::stopAcquisition()
 {
     commutator->stop();
+
+    if (numGaps > 0)
+        LOGC ("Commutator: bridged ", numGaps, " gaps in the quaternion stream, ", numMissingSamples, " samples missing in total.");
+
+    if (newlyCalibrated)
+    {
+        Vector3D<double> axis = getCalibratedAxis();
+        LOGC ("Commutator: calibrated rotation axis (", axis.x, ", ", axis.y, ", ", axis.z, ")");
+    }
+
     return true;
 }
 
@@ -109,11 +240,113 @@ void OECommutator::process (AudioBuffer<float>& buffer)
                 data[i] = buffer.getSample (chanIndex, nSamples - 1);
             }
 
-            commutator->setQuaternion (data);
+            double sampleRate = getDataStream (currentStream)->getSampleRate();
+            int64 firstSample = getFirstSampleNumberForBlock (currentStream);
+            int64 lastSample = firstSample + nSamples - 1;
+
+            commutator->setQuaternion (data, lastSample);
+
+            // Time from the previous block's last sample to this block's first one, longer than one sample after a dropped block
+            double sampleInterval = 1.0 / sampleRate;
+            double firstInterval = sampleInterval;
+
+            if (nextSampleNumber >= 0)
+            {
+                if (firstSample > nextSampleNumber)
+                {
+                    numGaps++;
+                    numMissingSamples += firstSample - nextSampleNumber;
+                }
+
+                firstInterval = (double) (firstSample - nextSampleNumber + 1) / sampleRate;
+            }
+
+            nextSampleNumber = lastSample + 1;
+
+            if (autoAxis && ! hasCalibratedAxis)
+                calibrateAxis (buffer, nSamples, sampleInterval, firstInterval);
+
+            if (hasOutputChannels())
+                writeOutputChannels (buffer, nSamples, sampleInterval, firstInterval);
+        }
+    }
+}
+
+std::array<const float*, OECommutator::NUM_QUATERNION_CHANNELS> OECommutator::getQuaternionChannels (AudioBuffer<float>& buffer)
+{
+    auto stream = getDataStream (currentStream);
+
+    std::array<const float*, NUM_QUATERNION_CHANNELS> channels;
+
+    for (int i = 0; i < NUM_QUATERNION_CHANNELS; i++)
+        channels[i] = buffer.getReadPointer (stream->getContinuousChannels()[channelIndices[i]]->getGlobalIndex());
+
+    return channels;
+}
+
+void OECommutator::writeOutputChannels (AudioBuffer<float>& buffer, int nSamples, double sampleInterval, double firstInterval)
+{
+    if (twistChannel != nullptr)
+    {
+        auto channels = getQuaternionChannels (buffer);
+        float* output = buffer.getWritePointer (twistChannel->getGlobalIndex());
+
+        outputTwist.process (channels[(int) QuaternionChannel::W],
+                             channels[(int) QuaternionChannel::X],
+                             channels[(int) QuaternionChannel::Y],
+                             channels[(int) QuaternionChannel::Z],
+                             output,
+                             nSamples,
+                             sampleInterval,
+                             firstInterval);
+    }
+
+    if (turnsChannel != nullptr)
+    {
+        FloatVectorOperations::fill (buffer.getWritePointer (turnsChannel->getGlobalIndex()), (float) commutator->getCumulativeTurns(), nSamples);
+    }
+}
+
+void OECommutator::calibrateAxis (AudioBuffer<float>& buffer, int nSamples, double sampleInterval, double firstInterval)
+{
+    auto channels = getQuaternionChannels (buffer);
+
+    for (int n = 0; n < nSamples; n++)
+    {
+        axisCalibrator.addSample ({ channels[0][n], channels[1][n], channels[2][n], channels[3][n] }, n == 0 ? firstInterval : sampleInterval);
+
+        if (axisCalibrator.isCalibrated())
+        {
+            Vector3D<double> axis = axisCalibrator.getAxis();
+            commutator->updateRotationAxis (axis);
+            outputTwist.setAxis (axis);
+
+            // Published like CommutatorThread's pending axis, since the message thread reads it while saving
+            {
+                SpinLock::ScopedLockType lock (calibrationLock);
+                calibratedAxis = axis;
+            }
+
+            hasCalibratedAxis = true;
+            newlyCalibrated = true;
+            break;
         }
     }
 }
 
+void OECommutator::setCalibratedAxis (Vector3D<double> axis)
+{
+    SpinLock::ScopedLockType lock (calibrationLock);
+    calibratedAxis = axis.length() > 0 ? axis.normalised() : Vector3D<double> (0, 0, 0);
+    hasCalibratedAxis = calibratedAxis.length() > 0;
+}
+
+Vector3D<double> OECommutator::getCalibratedAxis() const
+{
+    SpinLock::ScopedLockType lock (calibrationLock);
+    return calibratedAxis;
+}
+
 bool OECommutator::streamExists (uint16 streamId) const
 {
     for (auto stream : getDataStreams())
@@ -156,6 +389,12 @@ Vector3D<double> OECommutator::getRotationAxis (String axis) const
     {
         return Vector3D<double> (-1, 0, 0);
     }
+    else if (axis == "Auto")
+    {
+        // Track with the default axis until the calibration has converged
+        Vector3D<double> axis = getCalibratedAxis();
+        return axis.length() > 0 ? axis : Vector3D<double> (0, 0, 1);
+    }
     else
     {
         return Vector3D<double> (0, 0, 0);
@@ -23,7 +23,9 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #ifndef PROCESSORPLUGIN_H_DEFINED
 #define PROCESSORPLUGIN_H_DEFINED
 
+#include "AxisCalibrator.h"
 #include "CommutatorThread.h"
+#include "TwistEstimator.h"
 #include <ProcessorHeaders.h>
 
 class OECommutator : public GenericProcessor
@@ -35,6 +37,8 @@ public:
 
     void registerParameters() override;
 
+    void updateSettings() override;
+
     AudioProcessorEditor* createEditor() override;
 
     void process (AudioBuffer<float>& buffer) override;
@@ -59,7 +63,14 @@ public:
         Z = 3,
     };
 
-    inline static const std::array<std::string, 6> axes = { "+Z", "-Z", "+Y", "-Y", "+X", "-X" };
+    /** Selectable rotation axes. "Auto" estimates the axis from the quaternion stream during acquisition. */
+    inline static const std::array<std::string, 7> axes = { "+Z", "-Z", "+Y", "-Y", "+X", "-X", "Auto" };
+
+    /** Returns the automatically calibrated axis, or a zero-length vector if there is no calibration yet. */
+    Vector3D<double> getCalibratedAxis() const;
+
+    /** Restores a previously calibrated axis. A zero-length vector clears the calibration. */
+    void setCalibratedAxis (Vector3D<double> axis);
 
     /** Sets the quaternion channel indices within a specific stream. Quaternion indices are expected to be ordered X/Y/Z/W. */
     void setChannelIndices (std::array<int, NUM_QUATERNION_CHANNELS> indices);
@@ -76,7 +87,42 @@ private:
 
     bool streamExists (uint16 streamId) const;
 
+    /** Returns the read pointers of the W/X/Y/Z quaternion channels of the current stream. */
+    std::array<const float*, NUM_QUATERNION_CHANNELS> getQuaternionChannels (AudioBuffer<float>& buffer);
+
+    /** Adds an auxiliary output channel to the stream. */
+    ContinuousChannel* addOutputChannel (DataStream* stream, String name, String description, String identifier);
+
+    bool hasOutputChannels() const;
+
+    /** Fills the twist and commanded turns output channels for this block, in place. */
+    void writeOutputChannels (AudioBuffer<float>& buffer, int nSamples, double sampleInterval, double firstInterval);
+
+    /** Feeds every quaternion sample in the block to the axis calibrator. */
+    void calibrateAxis (AudioBuffer<float>& buffer, int nSamples, double sampleInterval, double firstInterval);
+
     std::array<int, NUM_QUATERNION_CHANNELS> channelIndices {};
+
+    bool autoAxis = false;
+    AxisCalibrator axisCalibrator;
+
+    /** Written on the audio thread when a calibration converges, and read on the message thread. */
+    mutable SpinLock calibrationLock;
+    Vector3D<double> calibratedAxis { 0, 0, 0 };
+    std::atomic<bool> hasCalibratedAxis { false };
+
+    /** Set when a calibration converged during the current acquisition, so it can be logged when it stops. */
+    bool newlyCalibrated = false;
+
+    /** Computes the twist output channel from every sample, independently of the control loop. */
+    TwistEstimator outputTwist;
+    ContinuousChannel* twistChannel = nullptr;
+    ContinuousChannel* turnsChannel = nullptr;
+
+    /** Sample number expected at the start of the next block, used to detect dropped blocks. */
+    int64 nextSampleNumber = -1;
+    int64 numGaps = 0;
+    int64 numMissingSamples = 0;
 };
 
 #endif
@@ -21,12 +21,13 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 */
 
 #include "OECommutatorEditor.h"
+#include "CommutatorSettingsPanel.h"
 #include "OECommutator.h"
 
 OECommutatorEditor::OECommutatorEditor (GenericProcessor* parentNode)
     : GenericEditor (parentNode)
 {
-    desiredWidth = 185;
+    desiredWidth = 235;
 
     vector<ofSerialDeviceInfo> devices = serial.getDeviceList();
 
@@ -60,7 +61,7 @@ OECommutatorEditor::OECommutatorEditor (GenericProcessor* parentNode)
     axisSelection = std::make_unique<ComboBox> ("Axis Override");
     axisSelection->setBounds (115, 50, 62, 20);
     axisSelection->setEnabled (axisOverride->getToggleState());
-    axisSelection->setTooltip ("Choose a specific axis to rotate around, based on the device orientation");
+    axisSelection->setTooltip ("Choose a specific axis to rotate around, based on the device orientation, or Auto to estimate it during acquisition");
     int count = 1;
     for (const auto& axis : OECommutator::axes)
     {
@@ -70,6 +71,13 @@ OECommutatorEditor::OECommutatorEditor (GenericProcessor* parentNode)
     axisSelection->addListener (this);
     addAndMakeVisible (axisSelection.get());
 
+    resetCalibrationButton = std::make_unique<UtilityButton> ("Reset");
+    resetCalibrationButton->setBounds (182, 51, 45, 18);
+    resetCalibrationButton->setRadius (2.0f);
+    resetCalibrationButton->setTooltip ("Clear the automatically calibrated axis, so that Auto estimates it again during the next acquisition");
+    resetCalibrationButton->addListener (this);
+    addAndMakeVisible (resetCalibrationButton.get());
+
     streamLabel = std::make_unique<Label> ("Stream label");
     streamLabel->setFont (labelFont);
     streamLabel->setText ("Stream", dontSendNotification);
@@ -99,6 +107,13 @@ OECommutatorEditor::OECommutatorEditor (GenericProcessor* parentNode)
     rightButton->addListener (this);
     rightButton->setRepeatSpeed (500, 100);
     addAndMakeVisible (rightButton.get());
+
+    settingsButton = std::make_unique<UtilityButton> ("Options");
+    settingsButton->setBounds (180, 96, 50, 18);
+    settingsButton->setRadius (2.0f);
+    settingsButton->setTooltip ("Output channels, serial protocol, motion, unwinding, diagnostics and scheduling options");
+    settingsButton->addListener (this);
+    addAndMakeVisible (settingsButton.get());
 }
 
 void OECommutatorEditor::setSerialSelection (std::string selection)
@@ -132,6 +147,15 @@ void OECommutatorEditor::buttonClicked (Button* btn)
     {
         axisSelection->setEnabled (btn->getToggleState());
     }
+    else if (btn == settingsButton.get())
+    {
+        CallOutBox::launchAsynchronously (std::make_unique<CommutatorSettingsPanel> (proc), btn->getScreenBounds(), nullptr);
+    }
+    else if (btn == resetCalibrationButton.get())
+    {
+        proc->setCalibratedAxis (Vector3D<double> (0, 0, 0));
+        CoreServices::sendStatusMessage ("Commutator: axis calibration cleared.");
+    }
 }
 
 void OECommutatorEditor::comboBoxChanged (ComboBox* cb)
@@ -149,6 +173,12 @@ void OECommutatorEditor::comboBoxChanged (ComboBox* cb)
     {
         getProcessor()->getParameter ("serial_name")->setNextValue (cb->getText());
     }
+    else if (cb == axisSelection.get())
+    {
+        // Switching to "Auto" from a fixed axis starts a new calibration at the next acquisition
+        if (cb->getText() == "Auto")
+            ((OECommutator*) getProcessor())->setCalibratedAxis (Vector3D<double> (0, 0, 0));
+    }
 }
 
 void OECommutatorEditor::updateSettings()
@@ -221,6 +251,8 @@ void OECommutatorEditor::startAcquisition()
     serialSelection->setEnabled (false);
     axisSelection->setEnabled (false);
     axisOverride->setEnabled (false);
+    resetCalibrationButton->setEnabled (false);
+    settingsButton->setEnabled (false);
 }
 
 void OECommutatorEditor::stopAcquisition()
@@ -229,29 +261,49 @@ void OECommutatorEditor::stopAcquisition()
     serialSelection->setEnabled (true);
     axisOverride->setEnabled (true);
     axisSelection->setEnabled (axisOverride->getToggleState());
+    resetCalibrationButton->setEnabled (true);
+    settingsButton->setEnabled (true);
 }
 
 void OECommutatorEditor::saveCustomParametersToXml (XmlElement* xml)
 {
     LOGD ("Saving OECommutatorEditor settings.");
 
-    xml->setAttribute ("COM_PORT", serialSelection->getText());
+    // Save the requested port rather than the selection, which is empty while a restored device is unplugged
+    String comPort = getProcessor()->getParameter ("serial_name")->getValueAsString();
+
+    xml->setAttribute ("COM_PORT", comPort);
+
+    if (comPort.isNotEmpty())
+        xml->setAttribute ("COM_PORT_ID", SerialConnectionManager::getStableId (comPort));
     xml->setAttribute ("OVERRIDE_STATUS", axisOverride->getToggleState());
     xml->setAttribute ("OVERRIDE_AXIS", axisSelection->getText());
+
+    Vector3D<double> calibratedAxis = ((OECommutator*) getProcessor())->getCalibratedAxis();
+
+    if (calibratedAxis.length() > 0)
+        xml->setAttribute ("CALIBRATED_AXIS", String (calibratedAxis.x) + " " + String (calibratedAxis.y) + " " + String (calibratedAxis.z));
 }
 
 void OECommutatorEditor::loadCustomParametersFromXml (XmlElement* xml)
 {
     LOGD ("Loading OECommutatorEditor settings.");
 
-    if (xml->hasAttribute ("COM_PORT"))
+    String comPort = xml->getStringAttribute ("COM_PORT");
+
+    // Prefer the device's stable ID, in case it was enumerated under a different path since the settings were saved
+    if (xml->hasAttribute ("COM_PORT_ID"))
     {
-        String comPort = xml->getStringAttribute ("COM_PORT");
+        String stableId = xml->getStringAttribute ("COM_PORT_ID");
+        String path = SerialConnectionManager::resolve (stableId);
 
-        if (comPort.contains ("COM") && ! comPort.isEmpty())
-        {
-            getProcessor()->getParameter ("serial_name")->setNextValue (comPort);
-        }
+        // If the device is not plugged in yet, keep waiting for it in the background
+        comPort = path.isNotEmpty() ? path : stableId;
+    }
+
+    if (comPort.isNotEmpty())
+    {
+        getProcessor()->getParameter ("serial_name")->setNextValue (comPort);
     }
 
     if (xml->hasAttribute ("OVERRIDE_STATUS"))
@@ -266,4 +318,12 @@ void OECommutatorEditor::loadCustomParametersFromXml (XmlElement* xml)
         if (axisIndex >= 0)
             axisSelection->setSelectedItemIndex (axisIndex, dontSendNotification);
     }
+
+    if (xml->hasAttribute ("CALIBRATED_AXIS"))
+    {
+        StringArray values = StringArray::fromTokens (xml->getStringAttribute ("CALIBRATED_AXIS"), false);
+
+        if (values.size() == 3)
+            ((OECommutator*) getProcessor())->setCalibratedAxis (Vector3D<double> (values[0].getDoubleValue(), values[1].getDoubleValue(), values[2].getDoubleValue()));
+    }
 }
@@ -63,6 +63,8 @@ private:
     std::unique_ptr<Label> serialLabel;
     std::unique_ptr<Label> streamLabel;
     std::unique_ptr<UtilityButton> axisOverride;
+    std::unique_ptr<UtilityButton> resetCalibrationButton;
+    std::unique_ptr<UtilityButton> settingsButton;
     std::unique_ptr<Label> manualTurnLabel;
     std::unique_ptr<ArrowButton> leftButton;
     std::unique_ptr<ArrowButton> rightButton;
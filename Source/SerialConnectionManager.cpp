@@ -0,0 +1,335 @@
+/*
+------------------------------------------------------------------
+
+This file is part of the Open Ephys GUI
+Copyright (C) 2022 Open Ephys
+
+------------------------------------------------------------------
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "SerialConnectionManager.h"
+#include "../../Source/Utils/Utils.h"
+
+#if JUCE_LINUX
+namespace
+{
+/** Returns "usb:<vendor>:<product>[:<serial number>]" for a tty that belongs to a USB device, or an empty string. */
+String getUsbId (const String& ttyName)
+{
+    File device = File ("/sys/class/tty/" + ttyName + "/device").getLinkedTarget();
+
+    // ACM devices sit one level below the USB device, and USB-serial adapters two or three
+    for (int level = 0; level < 4 && device.exists(); level++, device = device.getParentDirectory())
+    {
+        File vendor = device.getChildFile ("idVendor");
+
+        if (vendor.existsAsFile())
+        {
+            String id = "usb:" + vendor.loadFileAsString().trim() + ":" + device.getChildFile ("idProduct").loadFileAsString().trim();
+            String serialNumber = device.getChildFile ("serial").loadFileAsString().trim();
+
+            return serialNumber.isEmpty() ? id : id + ":" + serialNumber;
+        }
+    }
+
+    return {};
+}
+} // namespace
+#endif
+
+SerialConnectionManager::SerialConnectionManager()
+    : Thread ("Commutator Serial")
+{
+}
+
+SerialConnectionManager::~SerialConnectionManager()
+{
+    signalThreadShouldExit();
+    notify();
+    stopThread (2000);
+
+    closePort();
+}
+
+void SerialConnectionManager::connect (const String& port)
+{
+    {
+        ScopedLock lock (requestLock);
+
+        if (port == requestedPort)
+            return;
+
+        requestedPort = port;
+        requestChanged = true;
+    }
+
+    attemptFinished.reset();
+
+    if (isThreadRunning())
+        notify();
+    else
+        startThread();
+}
+
+void SerialConnectionManager::setPreferredFormat (SerialProtocol::Format preference)
+{
+    {
+        ScopedLock lock (requestLock);
+
+        if (preference == preferredFormat)
+            return;
+
+        preferredFormat = preference;
+        requestChanged = true;
+    }
+
+    if (isThreadRunning())
+    {
+        attemptFinished.reset();
+        notify();
+    }
+}
+
+bool SerialConnectionManager::waitForConnection (int timeoutMs)
+{
+    attemptFinished.wait (timeoutMs);
+    return isOpen();
+}
+
+int SerialConnectionManager::writeTurn (double turn)
+{
+    // The connection thread holds the lock while it opens the port, so check first rather than wait for it
+    if (state != State::Open)
+        return -1;
+
+    uint8 command[SerialProtocol::maxCommandSize];
+
+    ScopedLock lock (serialLock);
+
+    if (state != State::Open)
+        return -1;
+
+    int len = SerialProtocol::encodeTurn (format, turn, sequence++, command);
+    int n = serial.writeBytes (command, len);
+
+    if (n < 0)
+    {
+        LOGE ("Commutator: write to serial port failed. Reconnecting.");
+        state = State::Connecting;
+        notify();
+    }
+
+    return n;
+}
+
+void SerialConnectionManager::run()
+{
+    String target;
+    SerialProtocol::Format preference = SerialProtocol::Format::Json;
+    bool reportedFailure = false;
+
+    while (! threadShouldExit())
+    {
+        {
+            ScopedLock lock (requestLock);
+
+            if (requestChanged)
+            {
+                target = requestedPort;
+                preference = preferredFormat;
+                requestChanged = false;
+                reportedFailure = false;
+
+                closePort();
+            }
+        }
+
+        if (target.isEmpty())
+        {
+            state = State::Idle;
+            attemptFinished.signal();
+            wait (-1);
+            continue;
+        }
+
+        if (state != State::Open)
+        {
+            state = State::Connecting;
+
+            String path = resolve (target);
+            bool opened = path.isNotEmpty() && openPort (path, preference);
+
+            if (opened)
+            {
+                LOGD ("Opened serial port \"" + path + "\".");
+
+                // Follow the device rather than the path from now on, in case it comes back somewhere else
+                target = getStableId (path);
+                reportedFailure = false;
+            }
+            else if (! reportedFailure)
+            {
+                LOGE ("Unable to open serial port \"" + target + "\". Retrying in the background.");
+                reportedFailure = true;
+            }
+
+            attemptFinished.signal();
+            wait (opened ? watchIntervalMs : retryIntervalMs);
+            continue;
+        }
+
+#if ! JUCE_WINDOWS
+        // A device that was unplugged leaves its file descriptor open but its node gone
+        if (! File (openPath).exists())
+        {
+            LOGE ("Serial port \"" + openPath + "\" disappeared. Reconnecting.");
+            closePort();
+            continue;
+        }
+#endif
+
+        wait (watchIntervalMs);
+    }
+
+    closePort();
+}
+
+bool SerialConnectionManager::openPort (const String& path, SerialProtocol::Format preference)
+{
+    ScopedLock lock (serialLock);
+
+    serial.close();
+    format = SerialProtocol::Format::Json;
+
+    if (! serial.setup (path.toRawUTF8(), 9600))
+        return false;
+
+    if (preference == SerialProtocol::Format::Binary)
+        format = negotiateBinaryProtocol() ? SerialProtocol::Format::Binary : SerialProtocol::Format::Json;
+
+    openPath = path;
+    state = State::Open;
+
+    return true;
+}
+
+void SerialConnectionManager::closePort()
+{
+    if (state != State::Idle)
+        state = State::Connecting;
+
+    ScopedLock lock (serialLock);
+    serial.close();
+    openPath.clear();
+}
+
+bool SerialConnectionManager::negotiateBinaryProtocol()
+{
+    uint8 frame[SerialProtocol::frameSize];
+    SerialProtocol::encodeFrame (SerialProtocol::Hello, 0, sequence, frame);
+
+    serial.flush (true, false);
+
+    if (serial.writeBytes (frame, SerialProtocol::frameSize) != SerialProtocol::frameSize)
+        return false;
+
+    // Collect the reply and look for an acknowledgement frame anywhere in it, since a device that
+    // only speaks JSON may answer with text
+    uint8 reply[64];
+    int received = 0;
+    double deadline = Time::getMillisecondCounterHiRes() + negotiationTimeoutMs;
+
+    while (Time::getMillisecondCounterHiRes() < deadline && received < (int) sizeof (reply))
+    {
+        int available = serial.available();
+
+        if (available > 0)
+        {
+            int n = serial.readBytes (reply + received, jmin (available, (int) sizeof (reply) - received));
+            received += jmax (0, n);
+
+            for (int i = 0; i + SerialProtocol::frameSize <= received; i++)
+            {
+                SerialProtocol::Opcode opcode;
+                int32 value;
+                uint8 replySequence;
+
+                if (SerialProtocol::decodeFrame (reply + i, opcode, value, replySequence)
+                    && opcode == SerialProtocol::HelloAck
+                    && replySequence == sequence)
+                {
+                    sequence++;
+                    LOGD ("Commutator: using binary serial protocol.");
+                    return true;
+                }
+            }
+        }
+        else
+        {
+            Thread::sleep (5);
+        }
+    }
+
+    LOGD ("Commutator: device did not acknowledge the binary protocol. Using JSON commands.");
+    return false;
+}
+
+String SerialConnectionManager::getStableId (const String& path)
+{
+#if JUCE_LINUX
+    if (! File::isAbsolutePath (path))
+        return path;
+
+    File device = File (path).getLinkedTarget();
+
+    for (const auto& link : File ("/dev/serial/by-id").findChildFiles (File::findFiles, false))
+    {
+        if (link.getLinkedTarget() == device)
+            return link.getFullPathName();
+    }
+
+    String usbId = getUsbId (device.getFileName());
+
+    if (usbId.isNotEmpty())
+        return usbId;
+#endif
+
+    return path;
+}
+
+String SerialConnectionManager::resolve (const String& port)
+{
+#if JUCE_LINUX
+    if (port.startsWith ("usb:"))
+    {
+        for (const auto& tty : File ("/sys/class/tty").findChildFiles (File::findDirectories | File::findFiles, false))
+        {
+            if (getUsbId (tty.getFileName()) == port)
+                return "/dev/" + tty.getFileName();
+        }
+
+        return {};
+    }
+#endif
+
+    // Windows port names such as "COM3" are not file paths, and are opened as they are
+    if (! File::isAbsolutePath (port))
+        return port;
+
+    File file (port);
+
+    return file.exists() ? file.getLinkedTarget().getFullPathName() : String();
+}
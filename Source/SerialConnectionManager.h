@@ -0,0 +1,116 @@
+/*
+------------------------------------------------------------------
+
+This file is part of the Open Ephys GUI
+Copyright (C) 2022 Open Ephys
+
+------------------------------------------------------------------
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef SERIALCONNECTIONMANAGER_H_DEFINED
+#define SERIALCONNECTIONMANAGER_H_DEFINED
+
+#include "SerialProtocol.h"
+#include <BasicJuceHeader.h>
+#include <SerialLib.h>
+#include <atomic>
+
+/** Opens and configures the commutator's serial port on a background thread, and keeps it open.
+
+    The port is requested by path or by stable ID (see getStableId()). Once opened, the port is
+    watched and reopened if the device goes away, re-resolving its stable ID so that a device that
+    comes back under a different path is found again. No call made from the message thread or the
+    control loop waits on device I/O, except for the writes themselves.
+*/
+class SerialConnectionManager : private Thread
+{
+public:
+    enum class State
+    {
+        /** No port has been requested. */
+        Idle,
+        /** A port has been requested and is being opened, or is unavailable and will be retried. */
+        Connecting,
+        /** The port is open and the command format has been negotiated. */
+        Open,
+    };
+
+    SerialConnectionManager();
+    ~SerialConnectionManager() override;
+
+    /** Requests a connection to the given port path or stable ID. Returns immediately. An empty port closes the connection. */
+    void connect (const String& port);
+
+    /** Sets the preferred command format. If a port is open, it is reopened in the background to negotiate the new format. */
+    void setPreferredFormat (SerialProtocol::Format preference);
+
+    State getState() const { return state; }
+
+    bool isOpen() const { return state == State::Open; }
+
+    /** Returns the command format in use on the open port. */
+    SerialProtocol::Format getFormat() const { return format; }
+
+    /** Waits until the current connection attempt has finished. Returns true if the port is open. */
+    bool waitForConnection (int timeoutMs);
+
+    /** Encodes and writes a relative turn command. Returns the number of bytes written, or a negative value on error. */
+    int writeTurn (double turn);
+
+    /** Returns an identifier for the device at the given path that survives re-enumeration. On Linux, this is its
+        /dev/serial/by-id link if it has one, or "usb:<vendor>:<product>[:<serial number>]" for other USB devices.
+        Elsewhere, and for devices without a USB identity, the path itself is returned.
+    */
+    static String getStableId (const String& path);
+
+    /** Returns the current path of the device with the given stable ID or path, or an empty string if it is not present. */
+    static String resolve (const String& port);
+
+private:
+    void run() override;
+
+    /** Opens the port and negotiates the command format. Called on the connection thread with no lock held. */
+    bool openPort (const String& path, SerialProtocol::Format preference);
+
+    void closePort();
+
+    /** Offers the binary protocol to the device. Must be called with serialLock held. */
+    bool negotiateBinaryProtocol();
+
+    ofSerial serial;
+    CriticalSection serialLock;
+    uint8 sequence = 0;
+
+    /** Requested port and format, guarded by requestLock. The connection thread picks up changes through requestChanged. */
+    CriticalSection requestLock;
+    String requestedPort;
+    SerialProtocol::Format preferredFormat = SerialProtocol::Format::Json;
+    bool requestChanged = false;
+
+    /** Path of the open port. Only used on the connection thread. */
+    String openPath;
+
+    std::atomic<State> state { State::Idle };
+    std::atomic<SerialProtocol::Format> format { SerialProtocol::Format::Json };
+
+    WaitableEvent attemptFinished { true };
+
+    static constexpr double negotiationTimeoutMs = 200;
+    static constexpr int retryIntervalMs = 1000;
+    static constexpr int watchIntervalMs = 500;
+};
+
+#endif
@@ -0,0 +1,81 @@
+/*
+------------------------------------------------------------------
+
+This file is part of the Open Ephys GUI
+Copyright (C) 2022 Open Ephys
+
+------------------------------------------------------------------
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "SerialProtocol.h"
+#include <cstring>
+
+uint8 SerialProtocol::crc8 (const uint8* data, int numBytes)
+{
+    uint8 crc = 0;
+
+    for (int i = 0; i < numBytes; i++)
+    {
+        crc ^= data[i];
+
+        for (int bit = 0; bit < 8; bit++)
+            crc = (crc & 0x80) ? (uint8) ((crc << 1) ^ 0x07) : (uint8) (crc << 1);
+    }
+
+    return crc;
+}
+
+void SerialProtocol::encodeFrame (Opcode opcode, int32 value, uint8 sequence, uint8* frame)
+{
+    uint32 bits = (uint32) value;
+
+    frame[0] = syncByte;
+    frame[1] = opcode;
+    frame[2] = (uint8) (bits & 0xff);
+    frame[3] = (uint8) ((bits >> 8) & 0xff);
+    frame[4] = (uint8) ((bits >> 16) & 0xff);
+    frame[5] = (uint8) ((bits >> 24) & 0xff);
+    frame[6] = sequence;
+    frame[7] = crc8 (frame + 1, 6);
+}
+
+bool SerialProtocol::decodeFrame (const uint8* frame, Opcode& opcode, int32& value, uint8& sequence)
+{
+    if (frame[0] != syncByte || crc8 (frame + 1, 6) != frame[7])
+        return false;
+
+    opcode = (Opcode) frame[1];
+    value = (int32) ((uint32) frame[2] | ((uint32) frame[3] << 8) | ((uint32) frame[4] << 16) | ((uint32) frame[5] << 24));
+    sequence = frame[6];
+
+    return true;
+}
+
+int SerialProtocol::encodeTurn (Format format, double turn, uint8 sequence, uint8* buffer)
+{
+    if (format == Format::Binary)
+    {
+        double scaled = jlimit ((double) std::numeric_limits<int32>::min(), (double) std::numeric_limits<int32>::max(), std::round (turn * turnScale));
+        encodeFrame (Turn, (int32) scaled, sequence, buffer);
+        return frameSize;
+    }
+
+    String json = "{turn: " + String (turn, 5, false) + "}\r\n";
+    int len = jmin ((int) json.getNumBytesAsUTF8(), maxCommandSize);
+    std::memcpy (buffer, json.toRawUTF8(), (size_t) len);
+
+    return len;
+}
@@ -0,0 +1,78 @@
+/*
+------------------------------------------------------------------
+
+This file is part of the Open Ephys GUI
+Copyright (C) 2022 Open Ephys
+
+------------------------------------------------------------------
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef SERIALPROTOCOL_H_DEFINED
+#define SERIALPROTOCOL_H_DEFINED
+
+#include <BasicJuceHeader.h>
+
+/** Encodings for commands sent to the commutator.
+
+    The JSON format sends text such as "{turn: -0.12345}\r\n". The binary format sends 8-byte frames:
+
+        byte 0     sync (0xA5)
+        byte 1     opcode
+        bytes 2-5  value, signed 32-bit little-endian. For turns, in units of 1e-5 turns
+        byte 6     sequence number, incremented for every frame
+        byte 7     CRC-8 (polynomial 0x07) of bytes 1-6
+
+    The binary format is negotiated by sending a Hello frame, which a device that supports it
+    answers with a HelloAck frame carrying the same sequence number. Any other reply, or no reply,
+    selects the JSON format.
+*/
+namespace SerialProtocol
+{
+enum class Format
+{
+    Json,
+    Binary,
+};
+
+enum Opcode : uint8
+{
+    Turn = 0x01,
+    Hello = 0x02,
+    HelloAck = 0x82,
+};
+
+constexpr uint8 syncByte = 0xA5;
+constexpr int frameSize = 8;
+constexpr double turnScale = 1e5;
+
+/** Largest encoded command in either format, in bytes. */
+constexpr int maxCommandSize = 32;
+
+uint8 crc8 (const uint8* data, int numBytes);
+
+/** Writes a binary frame into the buffer, which must hold at least frameSize bytes. */
+void encodeFrame (Opcode opcode, int32 value, uint8 sequence, uint8* frame);
+
+/** Checks the sync byte and CRC of a binary frame and extracts its contents. */
+bool decodeFrame (const uint8* frame, Opcode& opcode, int32& value, uint8& sequence);
+
+/** Encodes a relative turn command in the given format. Returns the number of bytes written to
+    the buffer, which must hold at least maxCommandSize bytes.
+*/
+int encodeTurn (Format format, double turn, uint8 sequence, uint8* buffer);
+} // namespace SerialProtocol
+
+#endif
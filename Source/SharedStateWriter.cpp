@@ -0,0 +1,165 @@
+/*
+------------------------------------------------------------------
+
+This file is part of the Open Ephys GUI
+Copyright (C) 2022 Open Ephys
+
+------------------------------------------------------------------
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "SharedStateWriter.h"
+#include "../../Source/Utils/Utils.h"
+
+#if ! JUCE_WINDOWS
+#include "CommutatorSharedMemory.h"
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+static_assert (SharedStateWriter::commandFailed == OE_COMMUTATOR_COMMAND_FAILED, "Command flags must match the shared-memory layout");
+#endif
+
+SharedStateWriter::~SharedStateWriter()
+{
+    close();
+}
+
+#if JUCE_WINDOWS
+
+String SharedStateWriter::getRegionName (int nodeId)
+{
+    return "/oe-commutator-" + String (nodeId);
+}
+
+bool SharedStateWriter::open (const String& name)
+{
+    LOGE ("Commutator: shared-memory export is not supported on Windows.");
+    return false;
+}
+
+void SharedStateWriter::close() {}
+
+void SharedStateWriter::writeState (double, const std::array<double, 4>&, double, double, double) {}
+
+void SharedStateWriter::writeCommand (double, double, double, int, uint32) {}
+
+#else
+
+String SharedStateWriter::getRegionName (int nodeId)
+{
+    return OE_COMMUTATOR_SHM_PREFIX + String (nodeId);
+}
+
+bool SharedStateWriter::open (const String& name)
+{
+    close();
+
+    int fd = shm_open (name.toRawUTF8(), O_CREAT | O_RDWR, 0644);
+
+    if (fd < 0)
+    {
+        LOGE ("Commutator: unable to create shared memory \"", name, "\" (", std::strerror (errno), ").");
+        return false;
+    }
+
+    if (ftruncate (fd, sizeof (oe_commutator_shm)) != 0)
+    {
+        LOGE ("Commutator: unable to size shared memory \"", name, "\" (", std::strerror (errno), ").");
+        ::close (fd);
+        return false;
+    }
+
+    void* region = mmap (nullptr, sizeof (oe_commutator_shm), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    ::close (fd);
+
+    if (region == MAP_FAILED)
+    {
+        LOGE ("Commutator: unable to map shared memory \"", name, "\" (", std::strerror (errno), ").");
+        return false;
+    }
+
+    shm = static_cast<oe_commutator_shm*> (region);
+    shmName = name;
+
+    // Readers wait for the magic number, so it is published last
+    __atomic_store_n (&shm->magic, 0u, __ATOMIC_RELEASE);
+    std::memset (shm, 0, sizeof (oe_commutator_shm));
+    shm->version = OE_COMMUTATOR_SHM_VERSION;
+    shm->state_capacity = OE_COMMUTATOR_SHM_STATE_RECORDS;
+    shm->command_capacity = OE_COMMUTATOR_SHM_COMMAND_RECORDS;
+    __atomic_store_n (&shm->magic, OE_COMMUTATOR_SHM_MAGIC, __ATOMIC_RELEASE);
+
+    LOGD ("Commutator: exporting live state to shared memory \"", name, "\".");
+
+    return true;
+}
+
+void SharedStateWriter::close()
+{
+    if (shm == nullptr)
+        return;
+
+    __atomic_store_n (&shm->magic, 0u, __ATOMIC_RELEASE);
+    munmap (shm, sizeof (oe_commutator_shm));
+    shm_unlink (shmName.toRawUTF8());
+    shm = nullptr;
+}
+
+void SharedStateWriter::writeState (double timestamp, const std::array<double, 4>& quaternion, double twist, double cumulativeTwist, double cumulativeTurns)
+{
+    if (shm == nullptr)
+        return;
+
+    auto fill = [&] (oe_commutator_state& state)
+    {
+        oe_commutator_seqlock_begin (&state.sequence);
+        state.timestamp = timestamp;
+        std::copy (quaternion.begin(), quaternion.end(), state.quaternion);
+        state.twist = twist;
+        state.cumulative_twist = cumulativeTwist;
+        state.cumulative_turns = cumulativeTurns;
+        oe_commutator_seqlock_end (&state.sequence);
+    };
+
+    fill (shm->latest);
+
+    uint64_t n = shm->state_count;
+    fill (shm->states[n % OE_COMMUTATOR_SHM_STATE_RECORDS]);
+    __atomic_store_n (&shm->state_count, n + 1, __ATOMIC_RELEASE);
+}
+
+void SharedStateWriter::writeCommand (double timestamp, double turn, double cumulativeTurns, int numBytes, uint32 source)
+{
+    if (shm == nullptr)
+        return;
+
+    uint64_t n = shm->command_count;
+    oe_commutator_command& command = shm->commands[n % OE_COMMUTATOR_SHM_COMMAND_RECORDS];
+
+    oe_commutator_seqlock_begin (&command.sequence);
+    command.timestamp = timestamp;
+    command.turn = turn;
+    command.cumulative_turns = cumulativeTurns;
+    command.num_bytes = (uint32_t) jmax (0, numBytes);
+    command.source = source;
+    oe_commutator_seqlock_end (&command.sequence);
+
+    __atomic_store_n (&shm->command_count, n + 1, __ATOMIC_RELEASE);
+}
+
+#endif
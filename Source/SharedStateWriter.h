@@ -0,0 +1,62 @@
+/*
+------------------------------------------------------------------
+
+This file is part of the Open Ephys GUI
+Copyright (C) 2022 Open Ephys
+
+------------------------------------------------------------------
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef SHAREDSTATEWRITER_H_DEFINED
+#define SHAREDSTATEWRITER_H_DEFINED
+
+#include <BasicJuceHeader.h>
+
+struct oe_commutator_shm;
+
+/** Publishes the live commutator state in a POSIX shared-memory region, laid out as described
+    in CommutatorSharedMemory.h. Writes are plain stores and never block. There must be a single
+    writing thread for states, and a single writing thread at a time for commands.
+    Shared memory is not supported on Windows, where open() always fails.
+*/
+class SharedStateWriter
+{
+public:
+    ~SharedStateWriter();
+
+    /** Creates or reuses the shared-memory object with the given name, for example "/oe-commutator-100". */
+    bool open (const String& name);
+
+    void close();
+
+    bool isOpen() const { return shm != nullptr; }
+
+    /** Returns the region name used by the processor with the given node ID. */
+    static String getRegionName (int nodeId);
+
+    void writeState (double timestamp, const std::array<double, 4>& quaternion, double twist, double cumulativeTwist, double cumulativeTurns);
+
+    /** Flag OR'ed into a command's source when the write failed. Matches OE_COMMUTATOR_COMMAND_FAILED in CommutatorSharedMemory.h. */
+    static constexpr uint32 commandFailed = 0x80000000u;
+
+    void writeCommand (double timestamp, double turn, double cumulativeTurns, int numBytes, uint32 source);
+
+private:
+    oe_commutator_shm* shm = nullptr;
+    String shmName;
+};
+
+#endif
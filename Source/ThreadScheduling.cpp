@@ -0,0 +1,94 @@
+/*
+------------------------------------------------------------------
+
+This file is part of the Open Ephys GUI
+Copyright (C) 2022 Open Ephys
+
+------------------------------------------------------------------
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "ThreadScheduling.h"
+#include "../../Source/Utils/Utils.h"
+
+#if JUCE_WINDOWS
+#include <Windows.h>
+#else
+#include <cerrno>
+#include <cstring>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+#endif
+
+void ThreadScheduling::applyToCurrentThread (const SchedulingOptions& options)
+{
+    if (options.realtimePriority)
+    {
+#if JUCE_WINDOWS
+        if (! SetThreadPriority (GetCurrentThread(), THREAD_PRIORITY_TIME_CRITICAL))
+            LOGE ("Commutator: unable to raise control thread priority (error ", (int) GetLastError(), ").");
+#else
+        sched_param param {};
+        param.sched_priority = jlimit (sched_get_priority_min (SCHED_FIFO), sched_get_priority_max (SCHED_FIFO), options.priority);
+
+        int result = pthread_setschedparam (pthread_self(), SCHED_FIFO, &param);
+
+        if (result != 0)
+            LOGE ("Commutator: unable to set SCHED_FIFO priority ", param.sched_priority, " (", std::strerror (result), "). Running with default scheduling.");
+        else
+            LOGD ("Commutator: control thread running with SCHED_FIFO priority ", param.sched_priority);
+#endif
+    }
+
+    if (options.cpuCore >= 0)
+    {
+        if (options.cpuCore >= SystemStats::getNumCpus() || options.cpuCore >= 32)
+        {
+            LOGE ("Commutator: CPU core ", options.cpuCore, " is not available. Affinity unchanged.");
+        }
+        else
+        {
+            Thread::setCurrentThreadAffinityMask ((uint32) 1 << options.cpuCore);
+            LOGD ("Commutator: control thread pinned to CPU core ", options.cpuCore);
+        }
+    }
+}
+
+bool ThreadScheduling::lockProcessMemory (const SchedulingOptions& options)
+{
+    if (! options.lockMemory)
+        return false;
+
+#if JUCE_WINDOWS
+    LOGD ("Commutator: memory locking is not supported on Windows.");
+    return false;
+#else
+    if (mlockall (MCL_CURRENT | MCL_FUTURE) != 0)
+    {
+        LOGE ("Commutator: unable to lock process memory (", std::strerror (errno), ").");
+        return false;
+    }
+
+    return true;
+#endif
+}
+
+void ThreadScheduling::unlockProcessMemory()
+{
+#if ! JUCE_WINDOWS
+    munlockall();
+#endif
+}
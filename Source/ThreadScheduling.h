@@ -0,0 +1,57 @@
+/*
+------------------------------------------------------------------
+
+This file is part of the Open Ephys GUI
+Copyright (C) 2022 Open Ephys
+
+------------------------------------------------------------------
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef THREADSCHEDULING_H_DEFINED
+#define THREADSCHEDULING_H_DEFINED
+
+#include <BasicJuceHeader.h>
+
+/** Scheduling options for the commutator control thread. */
+struct SchedulingOptions
+{
+    /** Run with real-time (SCHED_FIFO) scheduling, or the closest equivalent on this platform. */
+    bool realtimePriority = false;
+
+    /** SCHED_FIFO priority, clamped to the range supported by the system. */
+    int priority = 80;
+
+    /** Pin the thread to this CPU core. A negative value leaves the affinity unchanged. */
+    int cpuCore = -1;
+
+    /** Lock all current and future pages of the process into memory. */
+    bool lockMemory = false;
+};
+
+namespace ThreadScheduling
+{
+/** Applies the priority and affinity options to the calling thread. Failures, for example
+    when the process lacks permission, are logged and the thread keeps its default settings.
+*/
+void applyToCurrentThread (const SchedulingOptions& options);
+
+/** Locks the process memory if requested. Returns true if memory is now locked. */
+bool lockProcessMemory (const SchedulingOptions& options);
+
+void unlockProcessMemory();
+} // namespace ThreadScheduling
+
+#endif
@@ -0,0 +1,97 @@
+/*
+------------------------------------------------------------------
+
+This file is part of the Open Ephys GUI
+Copyright (C) 2022 Open Ephys
+
+------------------------------------------------------------------
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "TwistEstimator.h"
+
+void TwistEstimator::setAxis (Vector3D<double> axis)
+{
+    rotationAxis = axis;
+
+    // Angles about the old axis are not comparable with angles about the new one
+    previousAngleAboutAxis = std::numeric_limits<double>::quiet_NaN();
+}
+
+void TwistEstimator::reset()
+{
+    previousAngleAboutAxis = std::numeric_limits<double>::quiet_NaN();
+    cumulativeTwist = 0;
+    velocity = 0;
+}
+
+double TwistEstimator::angleAboutAxis (const Quaternion<double>& quaternion, const Vector3D<double>& axis)
+{
+    // Project rotation axis onto the direction axis
+    double dotProduct = quaternion.vector * axis;
+
+    Vector3D<double> projection = axis;
+    double scaleFactor = dotProduct / (axis * axis);
+    projection *= scaleFactor;
+
+    Quaternion<double> rotationAboutAxis = Quaternion<double> (projection, quaternion.scalar).normalised();
+
+    if (dotProduct < 0) // Account for angle-axis flipping
+    {
+        rotationAboutAxis = Quaternion<double> (-rotationAboutAxis.vector, -rotationAboutAxis.scalar);
+    }
+
+    return 2 * std::acos (jlimit (-1.0, 1.0, rotationAboutAxis.scalar));
+}
+
+double TwistEstimator::update (const Quaternion<double>& quaternion, double dt)
+{
+    double angle = angleAboutAxis (quaternion, rotationAxis);
+    double twist = 0;
+
+    if (! std::isnan (previousAngleAboutAxis))
+    {
+        // Choose the branch of the wrapped angle closest to the angle predicted from the recent velocity
+        double predicted = dt > 0 ? velocity * jmin (dt, maxBridgeSeconds) : 0;
+        double difference = angle - previousAngleAboutAxis - predicted;
+        difference -= MathConstants<double>::twoPi * std::floor ((difference + MathConstants<double>::pi) / MathConstants<double>::twoPi);
+        twist = predicted + difference;
+
+        if (dt > 0)
+        {
+            double alpha = 1.0 - std::exp (-dt / velocityTimeConstant);
+            velocity += alpha * (twist / dt - velocity);
+        }
+    }
+
+    previousAngleAboutAxis = angle;
+
+    // Normalize twist feedback in units of turns
+    double turns = -twist / MathConstants<double>::twoPi;
+    cumulativeTwist += turns;
+
+    return turns;
+}
+
+void TwistEstimator::process (const float* w, const float* x, const float* y, const float* z, float* output, int numSamples, double sampleInterval, double firstInterval)
+{
+    for (int i = 0; i < numSamples; i++)
+    {
+        update (Quaternion<double> (x[i], y[i], z[i], w[i]), i == 0 ? firstInterval : sampleInterval);
+
+        if (output != nullptr)
+            output[i] = (float) cumulativeTwist;
+    }
+}
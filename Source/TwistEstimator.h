@@ -0,0 +1,80 @@
+/*
+------------------------------------------------------------------
+
+This file is part of the Open Ephys GUI
+Copyright (C) 2022 Open Ephys
+
+------------------------------------------------------------------
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef TWISTESTIMATOR_H_DEFINED
+#define TWISTESTIMATOR_H_DEFINED
+
+#include <BasicJuceHeader.h>
+#include <limits>
+
+/** Measures twist about a rotation axis from successive orientations, in turns.
+
+    When the time between orientations is known, the wrap-around of the angle is resolved around the
+    angle predicted from the recent angular velocity instead of the shortest path. This keeps the
+    twist correct across dropped samples and fast rotation, as long as the gap is shorter than maxBridgeSeconds.
+*/
+class TwistEstimator
+{
+public:
+    void setAxis (Vector3D<double> axis);
+
+    Vector3D<double> getAxis() const { return rotationAxis; }
+
+    /** Forgets the previous orientation and zeroes the cumulative twist. */
+    void reset();
+
+    /** Returns the twist since the previous orientation, or 0 for the first orientation after a reset.
+        dt is the time since the previous orientation in seconds, or 0 if it is unknown.
+    */
+    double update (const Quaternion<double>& quaternion, double dt = 0);
+
+    /** Computes the unwrapped cumulative twist for a block of samples. Inputs are the quaternion channels,
+        and the output may be null if only the cumulative twist is needed. firstInterval is the time between
+        the previous block's last sample and this block's first sample, which is longer than sampleInterval
+        when samples were dropped.
+    */
+    void process (const float* w, const float* x, const float* y, const float* z, float* output, int numSamples, double sampleInterval, double firstInterval);
+
+    double getCumulativeTwist() const { return cumulativeTwist; }
+
+    /** Returns the smoothed angular velocity about the axis, in turns per second. */
+    double getVelocity() const { return -velocity / MathConstants<double>::twoPi; }
+
+    /** Longest gap, in seconds, over which the angular velocity is extrapolated. */
+    static constexpr double maxBridgeSeconds = 1.0;
+
+    /** Returns the angle of the rotation about the axis, in radians, between 0 and 2 pi. */
+    static double angleAboutAxis (const Quaternion<double>& quaternion, const Vector3D<double>& axis);
+
+private:
+    Vector3D<double> rotationAxis { 0, 0, 0 };
+    double previousAngleAboutAxis = std::numeric_limits<double>::quiet_NaN();
+    double cumulativeTwist = 0;
+
+    /** Angular velocity about the axis, in radians per second. */
+    double velocity = 0;
+
+    /** Time constant of the velocity smoothing, in seconds. */
+    static constexpr double velocityTimeConstant = 0.2;
+};
+
+#endif
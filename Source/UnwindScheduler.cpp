@@ -0,0 +1,69 @@
+/*
+------------------------------------------------------------------
+
+This file is part of the Open Ephys GUI
+Copyright (C) 2022 Open Ephys
+
+------------------------------------------------------------------
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "UnwindScheduler.h"
+
+void UnwindScheduler::setSettings (Settings newSettings)
+{
+    settings = newSettings;
+}
+
+void UnwindScheduler::reset()
+{
+    hasPrevious = false;
+    stillTime = 0;
+    timeSinceStep = 0;
+}
+
+double UnwindScheduler::update (const Quaternion<double>& orientation, double residualTwist, double dt, bool tracking)
+{
+    if (! hasPrevious || dt <= 0)
+    {
+        previousOrientation = orientation;
+        hasPrevious = true;
+        return 0;
+    }
+
+    // Angle of the rotation between the two orientations, independent of the quaternion sign
+    double dot = std::abs (orientation.scalar * previousOrientation.scalar + orientation.vector * previousOrientation.vector);
+    double angle = 2.0 * std::acos (jmin (1.0, dot));
+
+    previousOrientation = orientation;
+
+    if (tracking || angle / dt > settings.stillnessThreshold)
+    {
+        stillTime = 0;
+        timeSinceStep = 0;
+        return 0;
+    }
+
+    stillTime += dt;
+    timeSinceStep += dt;
+
+    if (! isStill() || std::abs (residualTwist) < settings.minResidual || timeSinceStep < settings.stepInterval)
+        return 0;
+
+    double maxStep = settings.maxSpeed * timeSinceStep;
+    timeSinceStep = 0;
+
+    return jlimit (-maxStep, maxStep, residualTwist);
+}
@@ -0,0 +1,74 @@
+/*
+------------------------------------------------------------------
+
+This file is part of the Open Ephys GUI
+Copyright (C) 2022 Open Ephys
+
+------------------------------------------------------------------
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef UNWINDSCHEDULER_H_DEFINED
+#define UNWINDSCHEDULER_H_DEFINED
+
+#include <BasicJuceHeader.h>
+
+/** Detects periods where the animal is still, and schedules small rate-limited turns during
+    those periods to remove the residual twist left in the tether.
+*/
+class UnwindScheduler
+{
+public:
+    struct Settings
+    {
+        /** Angular speed, in radians per second, below which the animal is considered still. */
+        double stillnessThreshold = 0.2;
+
+        /** Seconds of continuous stillness required before unwinding starts. */
+        double holdTime = 5.0;
+
+        /** Residual twist, in turns, below which no unwinding is done. */
+        double minResidual = 0.05;
+
+        /** Unwinding speed limit, in turns per second. Each step covers at most this speed times the time since the previous step. */
+        double maxSpeed = 0.1;
+
+        /** Minimum time between unwinding steps, in seconds. */
+        double stepInterval = 1.0;
+    };
+
+    void setSettings (Settings settings);
+
+    void reset();
+
+    /** Updates the stillness estimate with the latest orientation, dt seconds after the previous one.
+        Returns the relative turn to send to unwind the residual twist, or 0 if nothing should be sent now.
+        No step is scheduled on a tick where the control loop is already tracking motion.
+    */
+    double update (const Quaternion<double>& orientation, double residualTwist, double dt, bool tracking);
+
+    bool isStill() const { return stillTime >= settings.holdTime; }
+
+private:
+    Settings settings;
+
+    Quaternion<double> previousOrientation;
+    bool hasPrevious = false;
+
+    double stillTime = 0;
+    double timeSinceStep = 0;
+};
+
+#endif
@@ -0,0 +1,412 @@
+/*
+------------------------------------------------------------------
+
+This file is part of the Open Ephys GUI
+Copyright (C) 2022 Open Ephys
+
+------------------------------------------------------------------
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+    Deterministic regression check for CommutatorThread. The control loop is driven by a
+    VirtualClock and writes JSON commands to a pseudo-terminal, which are read back and compared
+    against the motion that was fed in. Exits with a non-zero status if any check fails.
+
+    Usage:
+        commutator-check
+*/
+
+#include "../../Source/CommutatorThread.h"
+
+#include <chrono>
+#include <cstdio>
+#include <fcntl.h>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <unistd.h>
+
+namespace
+{
+constexpr double sampleRate = 100;
+constexpr double samplePeriodMs = 1000.0 / sampleRate;
+constexpr int tickMs = 100;
+
+/** Rounding of the JSON turn values, accumulated over many commands. */
+constexpr double jsonResolution = 1e-5;
+
+int numFailures = 0;
+
+void check (bool condition, const String& description)
+{
+    std::printf ("%s  %s\n", condition ? "pass" : "FAIL", description.toRawUTF8());
+
+    if (! condition)
+        numFailures++;
+}
+
+/** Pseudo-terminal whose master side collects everything written to the slave. */
+class CommandCapture
+{
+public:
+    ~CommandCapture()
+    {
+        running = false;
+
+        if (reader.joinable())
+            reader.join();
+
+        if (master >= 0)
+            close (master);
+    }
+
+    bool open()
+    {
+        master = posix_openpt (O_RDWR | O_NOCTTY);
+
+        if (master < 0 || grantpt (master) != 0 || unlockpt (master) != 0)
+            return false;
+
+        slavePath = ptsname (master);
+
+        int flags = fcntl (master, F_GETFL);
+        fcntl (master, F_SETFL, flags | O_NONBLOCK);
+
+        running = true;
+        reader = std::thread ([this]
+                              {
+                                  char buffer[4096];
+
+                                  while (running)
+                                  {
+                                      ssize_t n = read (master, buffer, sizeof (buffer));
+
+                                      if (n > 0)
+                                      {
+                                          std::lock_guard<std::mutex> lock (textLock);
+                                          text.append (buffer, (size_t) n);
+                                          lastRead = std::chrono::steady_clock::now();
+                                      }
+                                      else
+                                      {
+                                          std::this_thread::sleep_for (std::chrono::milliseconds (1));
+                                      }
+                                  }
+                              });
+
+        return true;
+    }
+
+    /** Waits until the terminal has been quiet for a moment, then returns the turns written since the last call. */
+    Array<double> takeTurns()
+    {
+        const auto quietTime = std::chrono::milliseconds (30);
+
+        while (true)
+        {
+            std::this_thread::sleep_for (quietTime);
+            std::lock_guard<std::mutex> lock (textLock);
+
+            if (std::chrono::steady_clock::now() - lastRead >= quietTime)
+                break;
+        }
+
+        std::string received;
+
+        {
+            std::lock_guard<std::mutex> lock (textLock);
+            received.swap (text);
+        }
+
+        Array<double> turns;
+
+        for (const auto& line : StringArray::fromLines (String (received)))
+        {
+            if (line.contains ("turn:"))
+                turns.add (line.fromFirstOccurrenceOf ("turn:", false, false).upToFirstOccurrenceOf ("}", false, false).trim().getDoubleValue());
+        }
+
+        return turns;
+    }
+
+    String slavePath;
+
+private:
+    int master = -1;
+    std::atomic<bool> running { false };
+    std::thread reader;
+
+    std::mutex textLock;
+    std::string text;
+    std::chrono::steady_clock::time_point lastRead;
+};
+
+/** Counts the commands the thread reports as written. */
+class CommandCounter : public CommutatorThread::Listener
+{
+public:
+    void turnSent (double turn, int numBytes, double) override
+    {
+        if (numBytes > 0)
+        {
+            numCommands++;
+            total = total + turn;
+        }
+    }
+
+    std::atomic<int> numCommands { 0 };
+    std::atomic<double> total { 0 };
+};
+
+double sum (const Array<double>& values)
+{
+    double total = 0;
+
+    for (auto value : values)
+        total += value;
+
+    return total;
+}
+
+/** Orientation rotated by the given number of turns about +Z, ordered W/X/Y/Z. */
+std::array<double, 4> rotationAboutZ (double turns)
+{
+    double halfAngle = turns * MathConstants<double>::pi;
+    return { std::cos (halfAngle), 0.0, 0.0, std::sin (halfAngle) };
+}
+
+/** Feeds one sample per period and advances the clock by the same amount. Samples for which skip
+    returns true are dropped, as if their block never arrived.
+*/
+struct Feeder
+{
+    CommutatorThread& commutator;
+    VirtualClock& clock;
+    int64 sampleNumber = 0;
+
+    void run (double seconds, std::function<double (double)> turnsAt, std::function<bool (double)> skip = nullptr)
+    {
+        int numSamples = roundToInt (seconds * sampleRate);
+
+        for (int i = 0; i < numSamples; i++, sampleNumber++)
+        {
+            double t = i / sampleRate;
+
+            if (skip == nullptr || ! skip (t))
+                commutator.setQuaternion (rotationAboutZ (turnsAt (t)), sampleNumber);
+
+            clock.advance (samplePeriodMs);
+        }
+    }
+};
+
+void checkDiscreteTracking (CommutatorThread& commutator, Feeder& feeder, CommandCapture& capture)
+{
+    commutator.setMotionMode (CommutatorThread::MotionMode::Discrete);
+    commutator.setAutoUnwind (false);
+    check (commutator.start(), "discrete: start");
+
+    feeder.run (0.5, [] (double) { return 0.0; });
+    feeder.run (4.0, [] (double t) { return 0.5 * t; });
+    feeder.run (1.0, [] (double) { return 2.0; });
+
+    commutator.stop();
+    auto turns = capture.takeTurns();
+
+    check (std::abs (std::abs (commutator.getCumulativeTwist()) - 2.0) < 0.01, "discrete: measured twist is 2 turns, got " + String (commutator.getCumulativeTwist()));
+    check (std::abs (sum (turns) - commutator.getCumulativeTwist()) < turns.size() * jsonResolution, "discrete: commands add up to the twist");
+    check (std::abs (sum (turns) - commutator.getCumulativeTurns()) < turns.size() * jsonResolution, "discrete: cumulative turns match the commands written");
+}
+
+void checkDroppedBlocks (CommutatorThread& commutator, Feeder& feeder, CommandCapture& capture)
+{
+    commutator.setMotionMode (CommutatorThread::MotionMode::Discrete);
+    commutator.setAutoUnwind (false);
+    check (commutator.start(), "gap: start");
+
+    // 0.25 s of samples go missing at 3 turns/s, so the shortest way around the wrapped angle is wrong by a turn
+    feeder.run (0.5, [] (double) { return 0.0; });
+    feeder.run (
+        3.0, [] (double t) { return 3.0 * t; }, [] (double t) { return t >= 1.5 && t < 1.75; });
+    feeder.run (1.0, [] (double) { return 9.0; });
+
+    commutator.stop();
+    auto turns = capture.takeTurns();
+
+    check (std::abs (std::abs (commutator.getCumulativeTwist()) - 9.0) < 0.02, "gap: twist is bridged across dropped samples, got " + String (commutator.getCumulativeTwist()));
+    check (std::abs (sum (turns) - commutator.getCumulativeTwist()) < turns.size() * jsonResolution, "gap: commands add up to the twist");
+}
+
+void checkProfiledMotion (CommutatorThread& commutator, Feeder& feeder, CommandCapture& capture)
+{
+    MotionPlanner::Limits limits;
+    commutator.setMotionMode (CommutatorThread::MotionMode::Profiled, limits);
+    commutator.setAutoUnwind (false);
+    check (commutator.start(), "profiled: start");
+
+    feeder.run (0.5, [] (double) { return 0.0; });
+    feeder.run (1.0, [] (double t) { return 3.0 * t; });
+    feeder.run (6.0, [] (double) { return 3.0; });
+
+    commutator.stop();
+    auto turns = capture.takeTurns();
+
+    // A waypoint covers at most one tick at full speed, plus a remainder held back for being below the minimum step
+    double largestStep = limits.maxSpeed * tickMs / 1000.0 + limits.minStep;
+    bool withinSpeed = true;
+
+    for (auto turn : turns)
+        withinSpeed = withinSpeed && std::abs (turn) <= largestStep + jsonResolution;
+
+    check (withinSpeed, "profiled: every waypoint respects the speed limit");
+    check (std::abs (sum (turns) - commutator.getCumulativeTwist()) < limits.deadband + turns.size() * jsonResolution, "profiled: profile comes to rest at the target");
+}
+
+void checkUnwindCountsManualTurns (CommutatorThread& commutator, Feeder& feeder, CommandCapture& capture)
+{
+    commutator.setMotionMode (CommutatorThread::MotionMode::Discrete);
+    commutator.setAutoUnwind (true);
+    check (commutator.start(), "unwind: start");
+
+    UnwindScheduler::Settings settings;
+
+    // Slow enough that the discrete mode never sends it, so it is all left as residual twist
+    feeder.run (0.5, [] (double) { return 0.0; });
+    feeder.run (4.0, [] (double t) { return 0.05 * t; });
+    feeder.run (20.0, [] (double) { return 0.2; });
+
+    auto unwound = capture.takeTurns();
+
+    check (std::abs (sum (unwound) - commutator.getCumulativeTwist()) < settings.minResidual, "unwind: residual twist is unwound while still, unwound " + String (sum (unwound)));
+
+    // The operator straightens the next drift by hand, which must not be unwound a second time
+    feeder.run (4.0, [] (double t) { return 0.2 + 0.05 * t; });
+
+    double correction = commutator.getCumulativeTwist() - commutator.getCumulativeTurns();
+    commutator.manualTurn (0.5 * correction);
+    commutator.manualTurn (0.5 * correction);
+
+    feeder.run (20.0, [] (double) { return 0.4; });
+
+    commutator.stop();
+    auto turns = capture.takeTurns();
+
+    check (turns.size() == 2, "unwind: manual correction is not unwound again, " + String (turns.size()) + " commands written");
+}
+
+void checkStartStopWithManualTurns (CommutatorThread& commutator, Feeder& feeder, CommandCapture& capture, CommandCounter& counter)
+{
+    commutator.setMotionMode (CommutatorThread::MotionMode::Discrete);
+    commutator.setAutoUnwind (false);
+
+    const int numCycles = 50;
+    const int manualTurnsPerCycle = 10;
+
+    bool allStarted = true;
+    bool quietAfterStop = true;
+    bool totalsMatch = true;
+    bool countsMatch = true;
+
+    for (int cycle = 0; cycle < numCycles; cycle++)
+    {
+        counter.numCommands = 0;
+        counter.total = 0;
+
+        allStarted = commutator.start() && allStarted;
+
+        // The clock ticks on another thread while this one sends manual turns and stops the loop part-way through
+        std::atomic<bool> stopped { false };
+        std::atomic<int> ticksAfterStop { 0 };
+
+        std::thread ticker ([&]
+                            {
+                                double start = feeder.sampleNumber / sampleRate;
+
+                                while (ticksAfterStop < 50)
+                                {
+                                    double t = feeder.sampleNumber / sampleRate - start;
+                                    commutator.setQuaternion (rotationAboutZ (0.5 * t), feeder.sampleNumber++);
+                                    feeder.clock.advance (samplePeriodMs);
+
+                                    if (stopped)
+                                        ticksAfterStop++;
+                                }
+                            });
+
+        for (int i = 0; i < manualTurnsPerCycle; i++)
+        {
+            commutator.manualTurn (0.01);
+            std::this_thread::sleep_for (std::chrono::microseconds (500 + 100 * (cycle % 7)));
+        }
+
+        commutator.stop();
+        auto turns = capture.takeTurns();
+        stopped = true;
+
+        ticker.join();
+        quietAfterStop = capture.takeTurns().isEmpty() && quietAfterStop;
+
+        totalsMatch = std::abs (sum (turns) - commutator.getCumulativeTurns()) < (turns.size() + 1) * jsonResolution && totalsMatch;
+        countsMatch = turns.size() == counter.numCommands && countsMatch;
+    }
+
+    check (allStarted, "start/stop: every cycle started");
+    check (quietAfterStop, "start/stop: no commands are written after stop()");
+    check (totalsMatch, "start/stop: cumulative turns match the commands written, including manual turns");
+    check (countsMatch, "start/stop: listeners saw every command that was written");
+}
+} // namespace
+
+int main()
+{
+    CommandCapture capture;
+
+    if (! capture.open())
+    {
+        std::printf ("Could not create a pseudo-terminal.\n");
+        return 1;
+    }
+
+    CommutatorThread commutator (std::make_unique<VirtualClock>());
+    auto& clock = static_cast<VirtualClock&> (commutator.getClock());
+
+    CommandCounter counter;
+    commutator.addListener (&counter);
+
+    commutator.setSerial (capture.slavePath);
+    commutator.setRotationAxis (Vector3D<double> (0, 0, 1));
+    commutator.setTickInterval (tickMs);
+    commutator.setSampleRate (sampleRate);
+
+    if (! commutator.waitForConnection (2000))
+    {
+        std::printf ("Could not open %s.\n", capture.slavePath.toRawUTF8());
+        return 1;
+    }
+
+    Feeder feeder { commutator, clock };
+
+    checkDiscreteTracking (commutator, feeder, capture);
+    checkDroppedBlocks (commutator, feeder, capture);
+    checkProfiledMotion (commutator, feeder, capture);
+    checkUnwindCountsManualTurns (commutator, feeder, capture);
+    checkStartStopWithManualTurns (commutator, feeder, capture, counter);
+
+    commutator.removeListener (&counter);
+
+    std::printf ("%d checks failed.\n", numFailures);
+    return numFailures == 0 ? 0 : 1;
+}
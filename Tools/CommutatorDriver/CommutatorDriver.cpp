@@ -0,0 +1,583 @@
+/*
+------------------------------------------------------------------
+
+This file is part of the Open Ephys GUI
+Copyright (C) 2022 Open Ephys
+
+------------------------------------------------------------------
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+    Headless driver for CommutatorThread. Feeds a quaternion stream into the same control loop
+    used by the plugin and reports throughput, command rate, latency percentiles and memory use.
+
+    Usage:
+        commutator-driver [options]
+
+        --port <path>        Serial port to write commands to
+        --pty                Create a pseudo-terminal and write commands to it instead of a real port
+        --source <src>       "synthetic" (default), "stdin" or the path of a text file
+        --rate <hz>          Quaternion input rate (default 100, up to several kHz)
+        --tick-ms <ms>       Control tick period (default 100)
+        --axis <axis>        Rotation axis, one of +Z -Z +Y -Y +X -X (default +Z)
+        --duration <s>       Stop after this many seconds (default: run until the source ends)
+        --report <s>         Reporting period (default 10)
+        --loop               Restart a file source when it reaches the end
+        --speed <turns/s>    Mean rotation speed of the synthetic source (default 0.05)
+        --binary             Negotiate the binary serial protocol, falling back to JSON
+        --profiled           Use the profiled motion mode instead of discrete turns
+        --max-speed <v>      Profiled mode speed limit in turns/s (default 1)
+        --max-accel <a>      Profiled mode acceleration limit in turns/s^2 (default 2)
+        --unwind             Unwind residual tether twist while the input is still
+        --flight-recorder <dir>  Dump recent control-loop history to this directory on anomalies
+        --realtime           Run the control thread with SCHED_FIFO priority
+        --cpu <core>         Pin the control thread to a CPU core
+        --mlock              Lock the process memory with mlockall
+        --virtual            Drive the control loop from a virtual clock, as fast as the input can be read
+
+    Input lines contain one quaternion ordered W X Y Z, separated by spaces or commas.
+*/
+
+#include "../../Source/CommutatorThread.h"
+
+#include <algorithm>
+#include <chrono>
+#include <csignal>
+#include <cstdio>
+#include <fcntl.h>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <thread>
+#include <unistd.h>
+
+namespace
+{
+std::atomic<bool> shouldExit { false };
+
+/** How long to wait for the serial port to open before giving up. */
+constexpr int connectionTimeoutMs = 2000;
+
+void handleSignal (int)
+{
+    shouldExit = true;
+}
+
+/** Fixed-size latency histogram with 10 us bins up to 1 s, so that multi-hour runs do not grow in memory. */
+class LatencyHistogram
+{
+public:
+    void add (double ms)
+    {
+        int bin = jlimit (0, numBins - 1, (int) (ms * binsPerMs));
+        bins[bin]++;
+        count++;
+        maximum = jmax (maximum, ms);
+        sum += ms;
+    }
+
+    double percentile (double p) const
+    {
+        if (count == 0)
+            return 0;
+
+        uint64 target = (uint64) std::ceil (p * (double) count);
+        uint64 cumulative = 0;
+
+        for (int i = 0; i < numBins; i++)
+        {
+            cumulative += bins[i];
+
+            if (cumulative >= target)
+                return (double) (i + 1) / binsPerMs;
+        }
+
+        return maximum;
+    }
+
+    double mean() const { return count > 0 ? sum / (double) count : 0; }
+
+    void reset()
+    {
+        bins.fill (0);
+        count = 0;
+        maximum = 0;
+        sum = 0;
+    }
+
+    uint64 count = 0;
+    double maximum = 0;
+
+private:
+    static constexpr int binsPerMs = 100;
+    static constexpr int numBins = 1000 * binsPerMs;
+
+    std::array<uint64, numBins> bins {};
+    double sum = 0;
+};
+
+class DriverStatistics : public CommutatorThread::Listener
+{
+public:
+    void tickCompleted (double intervalMs) override
+    {
+        ScopedLock lock (statsLock);
+        tickIntervals.add (intervalMs);
+        totalTicks++;
+    }
+
+    void turnSent (double turn, int numBytes, double writeMs) override
+    {
+        ScopedLock lock (statsLock);
+        writeLatencies.add (writeMs);
+        totalCommands++;
+        totalBytes += (uint64) jmax (0, numBytes);
+        totalTurns += turn;
+    }
+
+    void report (double elapsedSeconds, double windowSeconds, uint64 samplesInWindow, uint64 bytesDrained, int tickIntervalMs)
+    {
+        ScopedLock lock (statsLock);
+
+        double expectedTicks = elapsedSeconds * 1000.0 / tickIntervalMs;
+
+        std::printf ("[%9.1f s] input %8.1f Hz | ticks %llu (drift %+.1f) | commands %6.2f /s, %llu total, %llu bytes, net %+.3f turns\n",
+                     elapsedSeconds,
+                     samplesInWindow / windowSeconds,
+                     (unsigned long long) totalTicks,
+                     (double) totalTicks - expectedTicks,
+                     writeLatencies.count / windowSeconds,
+                     (unsigned long long) totalCommands,
+                     (unsigned long long) totalBytes,
+                     totalTurns);
+
+        std::printf ("              tick interval ms: mean %.2f p50 %.2f p99 %.2f max %.2f | write ms: p50 %.3f p95 %.3f p99 %.3f max %.3f | drained %llu bytes | rss %.1f MB\n",
+                     tickIntervals.mean(),
+                     tickIntervals.percentile (0.5),
+                     tickIntervals.percentile (0.99),
+                     tickIntervals.maximum,
+                     writeLatencies.percentile (0.5),
+                     writeLatencies.percentile (0.95),
+                     writeLatencies.percentile (0.99),
+                     writeLatencies.maximum,
+                     (unsigned long long) bytesDrained,
+                     getResidentSetSizeMB());
+
+        std::fflush (stdout);
+
+        tickIntervals.reset();
+        writeLatencies.reset();
+    }
+
+    static double getResidentSetSizeMB()
+    {
+        long pages = 0, residentPages = 0;
+        FILE* f = std::fopen ("/proc/self/statm", "r");
+
+        if (f == nullptr)
+            return 0;
+
+        if (std::fscanf (f, "%ld %ld", &pages, &residentPages) != 2)
+            residentPages = 0;
+
+        std::fclose (f);
+
+        return (double) residentPages * (double) sysconf (_SC_PAGESIZE) / (1024.0 * 1024.0);
+    }
+
+private:
+    CriticalSection statsLock;
+
+    LatencyHistogram tickIntervals;
+    LatencyHistogram writeLatencies;
+
+    uint64 totalTicks = 0;
+    uint64 totalCommands = 0;
+    uint64 totalBytes = 0;
+    double totalTurns = 0;
+};
+
+/** Pseudo-terminal whose master side is drained in the background, standing in for a commutator. */
+class PseudoTerminal
+{
+public:
+    ~PseudoTerminal()
+    {
+        running = false;
+
+        if (reader.joinable())
+            reader.join();
+
+        if (master >= 0)
+            close (master);
+    }
+
+    bool open()
+    {
+        master = posix_openpt (O_RDWR | O_NOCTTY);
+
+        if (master < 0 || grantpt (master) != 0 || unlockpt (master) != 0)
+            return false;
+
+        slavePath = ptsname (master);
+
+        int flags = fcntl (master, F_GETFL);
+        fcntl (master, F_SETFL, flags | O_NONBLOCK);
+
+        running = true;
+        reader = std::thread ([this]
+                              {
+                                  unsigned char buffer[4096];
+
+                                  while (running)
+                                  {
+                                      ssize_t n = read (master, buffer, sizeof (buffer));
+
+                                      if (n > 0)
+                                          bytesRead += (uint64) n;
+                                      else
+                                          std::this_thread::sleep_for (std::chrono::milliseconds (1));
+                                  }
+                              });
+
+        return true;
+    }
+
+    String slavePath;
+    std::atomic<uint64> bytesRead { 0 };
+
+private:
+    int master = -1;
+    std::atomic<bool> running { false };
+    std::thread reader;
+};
+
+/** Produces quaternions ordered W/X/Y/Z, matching the order CommutatorThread expects. */
+class QuaternionSource
+{
+public:
+    virtual ~QuaternionSource() = default;
+    virtual bool next (std::array<double, 4>& quaternion) = 0;
+};
+
+class StreamSource : public QuaternionSource
+{
+public:
+    StreamSource (std::istream& stream_, std::ifstream* file_, bool loop_)
+        : stream (stream_), file (file_), loop (loop_) {}
+
+    bool next (std::array<double, 4>& quaternion) override
+    {
+        std::string line;
+
+        while (true)
+        {
+            if (! std::getline (stream, line))
+            {
+                if (! loop || file == nullptr)
+                    return false;
+
+                file->clear();
+                file->seekg (0);
+                continue;
+            }
+
+            std::replace (line.begin(), line.end(), ',', ' ');
+            std::istringstream fields (line);
+
+            if (fields >> quaternion[0] >> quaternion[1] >> quaternion[2] >> quaternion[3])
+                return true;
+        }
+    }
+
+private:
+    std::istream& stream;
+    std::ifstream* file;
+    bool loop;
+};
+
+/** Rotation about +Z with a slowly varying speed, plus a small head tilt and sensor noise. */
+class SyntheticSource : public QuaternionSource
+{
+public:
+    SyntheticSource (double rateHz, double meanTurnsPerSecond)
+        : dt (1.0 / rateHz), meanSpeed (meanTurnsPerSecond) {}
+
+    bool next (std::array<double, 4>& quaternion) override
+    {
+        t += dt;
+
+        double speed = meanSpeed * (1.0 + 2.0 * std::sin (MathConstants<double>::twoPi * t / 60.0));
+        yaw += MathConstants<double>::twoPi * speed * dt + noise (rng) * 0.002;
+
+        double tilt = 0.15 * std::sin (MathConstants<double>::twoPi * t / 3.0);
+
+        Quaternion<double> yawRotation (Vector3D<double> (0, 0, std::sin (yaw / 2)), std::cos (yaw / 2));
+        Quaternion<double> tiltRotation (Vector3D<double> (std::sin (tilt / 2), 0, 0), std::cos (tilt / 2));
+        Quaternion<double> q = yawRotation * tiltRotation;
+
+        quaternion = { q.scalar, q.vector.x, q.vector.y, q.vector.z };
+        return true;
+    }
+
+private:
+    double dt;
+    double meanSpeed;
+    double t = 0;
+    double yaw = 0;
+
+    std::mt19937 rng { 42 };
+    std::normal_distribution<double> noise { 0.0, 1.0 };
+};
+
+Vector3D<double> parseAxis (const String& axis)
+{
+    if (axis == "+Z")
+        return Vector3D<double> (0, 0, 1);
+    else if (axis == "-Z")
+        return Vector3D<double> (0, 0, -1);
+    else if (axis == "+Y")
+        return Vector3D<double> (0, 1, 0);
+    else if (axis == "-Y")
+        return Vector3D<double> (0, -1, 0);
+    else if (axis == "+X")
+        return Vector3D<double> (1, 0, 0);
+    else if (axis == "-X")
+        return Vector3D<double> (-1, 0, 0);
+    else
+        return Vector3D<double> (0, 0, 0);
+}
+} // namespace
+
+int main (int argc, char* argv[])
+{
+    String port, source = "synthetic", axis = "+Z";
+    bool usePty = false, loop = false, useVirtualClock = false;
+    double rate = 100, duration = 0, reportPeriod = 10, speed = 0.05;
+    int tickMs = 100;
+    SchedulingOptions scheduling;
+    MotionPlanner::Limits motionLimits;
+    auto motionMode = CommutatorThread::MotionMode::Discrete;
+    bool autoUnwind = false;
+    auto protocol = SerialProtocol::Format::Json;
+    String flightRecorderDirectory;
+
+    for (int i = 1; i < argc; i++)
+    {
+        String arg (argv[i]);
+        String value = i + 1 < argc ? String (argv[i + 1]) : String();
+
+        if (arg == "--port")
+            port = value, i++;
+        else if (arg == "--pty")
+            usePty = true;
+        else if (arg == "--source")
+            source = value, i++;
+        else if (arg == "--rate")
+            rate = value.getDoubleValue(), i++;
+        else if (arg == "--tick-ms")
+            tickMs = value.getIntValue(), i++;
+        else if (arg == "--axis")
+            axis = value, i++;
+        else if (arg == "--duration")
+            duration = value.getDoubleValue(), i++;
+        else if (arg == "--report")
+            reportPeriod = value.getDoubleValue(), i++;
+        else if (arg == "--speed")
+            speed = value.getDoubleValue(), i++;
+        else if (arg == "--loop")
+            loop = true;
+        else if (arg == "--binary")
+            protocol = SerialProtocol::Format::Binary;
+        else if (arg == "--profiled")
+            motionMode = CommutatorThread::MotionMode::Profiled;
+        else if (arg == "--max-speed")
+            motionLimits.maxSpeed = value.getDoubleValue(), i++;
+        else if (arg == "--max-accel")
+            motionLimits.maxAcceleration = value.getDoubleValue(), i++;
+        else if (arg == "--unwind")
+            autoUnwind = true;
+        else if (arg == "--flight-recorder")
+            flightRecorderDirectory = value, i++;
+        else if (arg == "--realtime")
+            scheduling.realtimePriority = true;
+        else if (arg == "--cpu")
+            scheduling.cpuCore = value.getIntValue(), i++;
+        else if (arg == "--mlock")
+            scheduling.lockMemory = true;
+        else if (arg == "--virtual")
+            useVirtualClock = true;
+        else
+        {
+            std::cerr << "Unknown option: " << argv[i] << std::endl;
+            return 1;
+        }
+    }
+
+    if (rate <= 0 || reportPeriod <= 0 || (port.isEmpty() && ! usePty))
+    {
+        std::cerr << "A serial port (--port) or --pty is required, and --rate and --report must be positive." << std::endl;
+        return 1;
+    }
+
+    std::signal (SIGINT, handleSignal);
+    std::signal (SIGTERM, handleSignal);
+
+    PseudoTerminal pty;
+
+    if (usePty)
+    {
+        if (! pty.open())
+        {
+            std::cerr << "Unable to create a pseudo-terminal." << std::endl;
+            return 1;
+        }
+
+        port = pty.slavePath;
+        std::printf ("Writing commands to %s\n", port.toRawUTF8());
+    }
+
+    std::ifstream file;
+    std::unique_ptr<QuaternionSource> quaternions;
+
+    if (source == "synthetic")
+        quaternions = std::make_unique<SyntheticSource> (rate, speed);
+    else if (source == "stdin")
+        quaternions = std::make_unique<StreamSource> (std::cin, nullptr, false);
+    else
+    {
+        file.open (source.toStdString());
+
+        if (! file.is_open())
+        {
+            std::cerr << "Unable to open " << source << std::endl;
+            return 1;
+        }
+
+        quaternions = std::make_unique<StreamSource> (file, &file, loop);
+    }
+
+    DriverStatistics stats;
+
+    VirtualClock* virtualClock = nullptr;
+    std::unique_ptr<CommutatorClock> clock;
+
+    if (useVirtualClock)
+    {
+        auto ownedClock = std::make_unique<VirtualClock>();
+        virtualClock = ownedClock.get();
+        clock = std::move (ownedClock);
+    }
+    else
+    {
+        clock = std::make_unique<RealTimeClock>();
+    }
+
+    CommutatorThread commutator (std::move (clock));
+
+    commutator.setProtocolPreference (protocol);
+    commutator.setSerial (port);
+    commutator.setRotationAxis (parseAxis (axis));
+    commutator.setTickInterval (tickMs);
+    commutator.setSampleRate (rate);
+    commutator.setSchedulingOptions (scheduling);
+    commutator.setMotionMode (motionMode, motionLimits);
+    commutator.setAutoUnwind (autoUnwind);
+
+    if (flightRecorderDirectory.isNotEmpty())
+        commutator.setFlightRecorder (true, File::getCurrentWorkingDirectory().getChildFile (flightRecorderDirectory));
+    commutator.addListener (&stats);
+
+    String statusMessage;
+
+    // The port is opened in the background, so give it a moment before checking
+    commutator.waitForConnection (connectionTimeoutMs);
+
+    if (! commutator.isReady (statusMessage) || ! commutator.start())
+    {
+        std::cerr << "Commutator is not ready: " << statusMessage << std::endl;
+        return 1;
+    }
+
+    using Clock = std::chrono::steady_clock;
+
+    const auto startTime = Clock::now();
+    const double samplePeriod = 1.0 / rate;
+
+    // In virtual mode the loop never sleeps, and time only moves forward as samples are fed in
+    auto elapsedSeconds = [&]
+    {
+        if (virtualClock != nullptr)
+            return virtualClock->now() / 1000.0;
+
+        return std::chrono::duration<double> (Clock::now() - startTime).count();
+    };
+
+    double nextSample = 0;
+    double nextReport = reportPeriod;
+    double lastReport = 0;
+
+    uint64 samplesInWindow = 0;
+    int64 sampleNumber = 0;
+    std::array<double, 4> quaternion;
+
+    while (! shouldExit)
+    {
+        if (! quaternions->next (quaternion))
+            break;
+
+        commutator.setQuaternion (quaternion, sampleNumber);
+        sampleNumber++;
+        samplesInWindow++;
+
+        nextSample += samplePeriod;
+
+        if (virtualClock != nullptr)
+            virtualClock->advance (samplePeriod * 1000.0);
+        else
+            std::this_thread::sleep_until (startTime + std::chrono::duration_cast<Clock::duration> (std::chrono::duration<double> (nextSample)));
+
+        double elapsed = elapsedSeconds();
+
+        if (elapsed >= nextReport)
+        {
+            stats.report (elapsed, elapsed - lastReport, samplesInWindow, pty.bytesRead, tickMs);
+            samplesInWindow = 0;
+            lastReport = elapsed;
+            nextReport += reportPeriod;
+        }
+
+        if (duration > 0 && elapsed >= duration)
+            break;
+    }
+
+    commutator.stop();
+    commutator.removeListener (&stats);
+
+    auto jitter = commutator.getJitterStatistics();
+
+    std::printf ("Tick jitter: %lld ticks, mean interval %.3f ms, std dev %.3f ms, max lateness %.3f ms\n",
+                 (long long) jitter.numTicks,
+                 jitter.meanIntervalMs,
+                 jitter.stdDevIntervalMs,
+                 jitter.maxLatenessMs);
+
+    double elapsed = elapsedSeconds();
+    stats.report (elapsed, jmax (1e-3, elapsed - lastReport), samplesInWindow, pty.bytesRead, tickMs);
+
+    return 0;
+}
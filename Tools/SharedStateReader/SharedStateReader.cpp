@@ -0,0 +1,222 @@
+/*
+------------------------------------------------------------------
+
+This file is part of the Open Ephys GUI
+Copyright (C) 2022 Open Ephys
+
+------------------------------------------------------------------
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+    Reference reader for the commutator shared-memory region. Depends only on the C layout header.
+
+    Usage:
+        shared-state-reader <node id> [--interval <ms>] [--check]
+
+    Prints the latest state and every new command. With --check, it also follows the state ring
+    and reports records that were overwritten before they could be read, or that went backwards in time.
+    It waits for the region if it does not exist yet, and remaps it when the export is turned off and on again.
+*/
+
+#include "../../Source/CommutatorSharedMemory.h"
+
+#include <chrono>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <string>
+#include <sys/mman.h>
+#include <thread>
+#include <unistd.h>
+
+namespace
+{
+volatile std::sig_atomic_t shouldExit = 0;
+
+void handleSignal (int)
+{
+    shouldExit = 1;
+}
+
+const char* sourceName (uint32_t source)
+{
+    switch (source)
+    {
+        case OE_COMMUTATOR_COMMAND_TRACKING:
+            return "tracking";
+        case OE_COMMUTATOR_COMMAND_MANUAL:
+            return "manual";
+        case OE_COMMUTATOR_COMMAND_UNWIND:
+            return "unwind";
+        default:
+            return "unknown";
+    }
+}
+
+/** Maps the named region read-only. Returns nullptr, with errno set, if it does not exist yet. */
+const oe_commutator_shm* mapRegion (const std::string& name)
+{
+    int fd = shm_open (name.c_str(), O_RDONLY, 0);
+
+    if (fd < 0)
+        return nullptr;
+
+    void* region = mmap (nullptr, sizeof (oe_commutator_shm), PROT_READ, MAP_SHARED, fd, 0);
+    int error = errno;
+    close (fd);
+
+    if (region == MAP_FAILED)
+    {
+        errno = error;
+        return nullptr;
+    }
+
+    return static_cast<const oe_commutator_shm*> (region);
+}
+} // namespace
+
+int main (int argc, char* argv[])
+{
+    if (argc < 2)
+    {
+        std::fprintf (stderr, "Usage: %s <node id> [--interval <ms>] [--check]\n", argv[0]);
+        return 1;
+    }
+
+    std::string name = std::string (OE_COMMUTATOR_SHM_PREFIX) + argv[1];
+    int intervalMs = 100;
+    bool check = false;
+
+    for (int i = 2; i < argc; i++)
+    {
+        if (std::strcmp (argv[i], "--interval") == 0 && i + 1 < argc)
+            intervalMs = std::atoi (argv[++i]);
+        else if (std::strcmp (argv[i], "--check") == 0)
+            check = true;
+    }
+
+    const oe_commutator_shm* shm = mapRegion (name);
+
+    if (shm == nullptr)
+        std::fprintf (stderr, "Waiting for shared memory %s: %s\n", name.c_str(), std::strerror (errno));
+
+    std::signal (SIGINT, handleSignal);
+    std::signal (SIGTERM, handleSignal);
+
+    uint64_t nextCommand = 0;
+    uint64_t nextState = 0;
+    uint64_t missedStates = 0;
+    uint64_t checkedStates = 0;
+    double lastStateTime = 0;
+    bool started = false;
+
+    while (! shouldExit)
+    {
+        std::this_thread::sleep_for (std::chrono::milliseconds (intervalMs));
+
+        if (shm == nullptr && (shm = mapRegion (name)) == nullptr)
+            continue;
+
+        // A closed region is invalidated and unlinked, and a later export creates a new one under the same
+        // name. Drop the stale mapping, and map whatever region has the name on the next pass.
+        if (! oe_commutator_shm_is_valid (shm))
+        {
+            munmap ((void*) shm, sizeof (oe_commutator_shm));
+            shm = nullptr;
+
+            if (started)
+                std::printf ("Shared memory %s was closed, reconnecting\n", name.c_str());
+
+            started = false;
+            continue;
+        }
+
+        if (! started)
+        {
+            // Start from the records still available, rather than from the beginning of the session
+            uint64_t states = __atomic_load_n (&shm->state_count, __ATOMIC_ACQUIRE);
+            uint64_t commands = __atomic_load_n (&shm->command_count, __ATOMIC_ACQUIRE);
+            nextState = states > shm->state_capacity ? states - shm->state_capacity : 0;
+            nextCommand = commands > shm->command_capacity ? commands - shm->command_capacity : 0;
+            started = true;
+        }
+
+        oe_commutator_state state;
+
+        if (oe_commutator_read_latest (shm, &state))
+        {
+            std::printf ("%12.1f ms  q = [%+.4f %+.4f %+.4f %+.4f]  twist %+.5f  cumulative twist %+.4f  turns %+.4f\n",
+                         state.timestamp,
+                         state.quaternion[0],
+                         state.quaternion[1],
+                         state.quaternion[2],
+                         state.quaternion[3],
+                         state.twist,
+                         state.cumulative_twist,
+                         state.cumulative_turns);
+        }
+
+        oe_commutator_command command;
+        uint64_t commandCount = __atomic_load_n (&shm->command_count, __ATOMIC_ACQUIRE);
+
+        for (; nextCommand < commandCount; nextCommand++)
+        {
+            if (oe_commutator_read_command (shm, nextCommand, &command))
+            {
+                std::printf ("%12.1f ms  command %llu: %+.5f turns (%s%s, %u bytes), total %+.4f\n",
+                             command.timestamp,
+                             (unsigned long long) nextCommand,
+                             command.turn,
+                             sourceName (command.source & ~OE_COMMUTATOR_COMMAND_FAILED),
+                             (command.source & OE_COMMUTATOR_COMMAND_FAILED) ? ", failed" : "",
+                             command.num_bytes,
+                             command.cumulative_turns);
+            }
+        }
+
+        if (check)
+        {
+            uint64_t stateCount = __atomic_load_n (&shm->state_count, __ATOMIC_ACQUIRE);
+
+            for (; nextState < stateCount; nextState++)
+            {
+                if (! oe_commutator_read_state (shm, nextState, &state))
+                {
+                    missedStates++;
+                    continue;
+                }
+
+                if (checkedStates > 0 && state.timestamp < lastStateTime)
+                    std::printf ("State %llu went back in time (%.3f < %.3f ms)\n", (unsigned long long) nextState, state.timestamp, lastStateTime);
+
+                lastStateTime = state.timestamp;
+                checkedStates++;
+            }
+        }
+
+        std::fflush (stdout);
+    }
+
+    if (check)
+        std::printf ("Checked %llu states, missed %llu\n", (unsigned long long) checkedStates, (unsigned long long) missedStates);
+
+    if (shm != nullptr)
+        munmap ((void*) shm, sizeof (oe_commutator_shm));
+
+    return 0;
+}